@@ -0,0 +1,59 @@
+/*
+alloc_stats.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef ALLOC_STATS_HPP
+#define ALLOC_STATS_HPP
+
+#include <cstdint>
+
+namespace floaty
+{
+
+/*
+Heap accounting of the calling thread, only maintained when the assembler is configured with
+-DFLOATY_ALLOC_STATS=ON, which replaces the global operator new and delete (see alloc_stats.cpp).
+Sizes are the usable sizes of the blocks as reported by malloc, so that a delete can subtract exactly what
+the matching new added. Memory freed by another thread than the one which allocated it lowers that
+thread's live bytes instead.
+*/
+struct ThreadAllocs
+{
+    uint64_t count { 0 };
+    uint64_t bytes { 0 };
+    int64_t live { 0 };
+    // highest 'live' since it was last reset, ScopedPhase resets it to measure the peak of a phase
+    int64_t peak { 0 };
+};
+
+#ifdef FLOATY_ALLOC_STATS
+constexpr bool alloc_stats_enabled = true;
+#else
+constexpr bool alloc_stats_enabled = false;
+#endif
+
+ThreadAllocs& thread_allocs();
+
+}
+
+#endif // ALLOC_STATS_HPP
@@ -0,0 +1,83 @@
+/*
+arena.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+namespace floaty
+{
+
+// Bump allocator over a list of blocks. Deallocation is a no-op, reset() makes the whole arena available again
+// without giving the blocks back, so a workload that repeats itself stops allocating after the first run.
+// Not thread safe.
+class Arena : public std::pmr::memory_resource
+{
+public:
+    explicit Arena(size_t block_size = 64*1024)
+        : block_size(block_size)
+    {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Everything allocated so far must be dead
+    void reset()
+    {
+        current = 0;
+        offset = 0;
+    }
+
+    // Total size of the blocks
+    size_t capacity() const;
+
+private:
+    struct Block
+    {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    void* do_allocate(size_t bytes, size_t alignment) override;
+    void do_deallocate(void*, size_t, size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+    size_t block_size;
+    std::vector<Block> blocks;
+    // block being allocated from and the first free byte in it
+    size_t current { 0 };
+    size_t offset { 0 };
+};
+
+}
+
+#endif // ARENA_HPP
@@ -25,6 +25,9 @@ SOFTWARE.
 #ifndef ASSEMBLER_HPP
 #define ASSEMBLER_HPP
 
+#include <algorithm>
+#include <memory>
+#include <memory_resource>
 #include <string>
 #include <vector>
 #include <variant>
@@ -33,6 +36,8 @@ SOFTWARE.
 
 #include <gsl/gsl_span.hpp>
 
+#include "image_stats.hpp"
+
 namespace floaty
 {
 
@@ -66,8 +71,135 @@ struct Instruction : public CommonDirective
 
 using AssemblerDirective = std::variant<Instruction>;
 
+// A run of bytes written by the program
+struct Segment
+{
+    size_t address { 0 };
+    size_t size { 0 };
+};
+
+// Where the program writes in its image : sorted, non-overlapping and non-adjacent segments, the bytes in between
+// (skipped over by SEEK) and up to 'size' are zero fill
+struct ImageLayout
+{
+    std::vector<Segment> segments;
+    size_t size { 0 };
+};
+
+// Destination of an assembled image.
+// The assembler knows the layout of the image after its first pass : it calls allocate_segments() once and
+// encodes straight into the returned buffers, one per segment.
+// By default the whole image is allocate()d as one zero-filled buffer and the segments are views into it,
+// sparse sinks override allocate_segments() so that the gaps never take any memory.
+class OutputSink
+{
+public:
+    virtual ~OutputSink() = default;
+
+    virtual gsl::span<uint8_t> allocate(size_t size) = 0;
+
+    virtual std::vector<gsl::span<uint8_t>> allocate_segments(const ImageLayout& layout)
+    {
+        return segment_views(allocate(layout.size), layout);
+    }
+
+protected:
+    static std::vector<gsl::span<uint8_t>> segment_views(gsl::span<uint8_t> image, const ImageLayout& layout)
+    {
+        std::vector<gsl::span<uint8_t>> buffers;
+        buffers.reserve(layout.segments.size());
+        for (const auto& segment : layout.segments)
+        {
+            buffers.emplace_back(image.subspan(segment.address, segment.size));
+        }
+        return buffers;
+    }
+};
+
+// Assembles into a vector owned by the sink
+class VectorSink : public OutputSink
+{
+public:
+    gsl::span<uint8_t> allocate(size_t size) override
+    {
+        data.assign(size, 0);
+        return data;
+    }
+
+    std::vector<uint8_t> data;
+};
+
+// Assembles into a caller-provided buffer, which must be large enough for the whole image
+class SpanSink : public OutputSink
+{
+public:
+    explicit SpanSink(gsl::span<uint8_t> buffer)
+        : buffer(buffer)
+    {}
+
+    gsl::span<uint8_t> allocate(size_t size) override
+    {
+        if (size > (size_t)buffer.size())
+        {
+            throw std::length_error("output buffer too small : " + std::to_string(buffer.size())
+                                    + " bytes, the image needs " + std::to_string(size));
+        }
+        auto image = buffer.first(size);
+        std::fill(image.begin(), image.end(), 0);
+        return image;
+    }
+
+private:
+    gsl::span<uint8_t> buffer;
+};
+
+// Keeps only the written segments, back to back
+class SegmentSink : public OutputSink
+{
+public:
+    gsl::span<uint8_t> allocate(size_t size) override;
+    std::vector<gsl::span<uint8_t>> allocate_segments(const ImageLayout& layout) override;
+
+    // The bytes of 'segment', which must be one of layout.segments
+    gsl::span<const uint8_t> segment_data(size_t segment) const
+    {
+        return gsl::span<const uint8_t>(data).subspan(offsets[segment], layout.segments[segment].size);
+    }
+
+    // Builds the flat image, gaps included
+    std::vector<uint8_t> flatten() const;
+
+    ImageLayout layout;
+    std::vector<uint8_t> data;
+
+private:
+    std::vector<size_t> offsets;
+};
+
+// The symbol table is allocated from 'scratch', which only has to live until assemble() returns.
+// If 'stats' is given, it is filled while encoding.
+void assemble(gsl::span<const AssemblerDirective> instructions, OutputSink& sink,
+              std::pmr::memory_resource* scratch = std::pmr::get_default_resource(), ImageStats* stats = nullptr);
 std::vector<uint8_t> assemble(gsl::span<const AssemblerDirective> instructions);
 
+// Assembles a program handed over in batches, in order. Each add() runs the first pass over its batch, so the
+// layout and the symbol table are built while the rest of the program is still being parsed; encoding waits for
+// finish() since instructions can refer to labels defined further down.
+// Gives the same image, errors and stats as assemble() over the concatenated batches.
+class IncrementalAssembler
+{
+public:
+    explicit IncrementalAssembler(std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
+    ~IncrementalAssembler();
+
+    void add(std::vector<AssemblerDirective>&& batch);
+    void finish(OutputSink& sink, ImageStats* stats = nullptr);
+
+private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
 }
 
 #endif // ASSEMBLER_HPP
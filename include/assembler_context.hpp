@@ -0,0 +1,83 @@
+/*
+assembler_context.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef ASSEMBLER_CONTEXT_HPP
+#define ASSEMBLER_CONTEXT_HPP
+
+#include <cstdint>
+
+#include <string>
+#include <string_view>
+
+#include <gsl/gsl_span.hpp>
+
+#include "arena.hpp"
+#include "assembler.hpp"
+#include "parser.hpp"
+#include "preprocessor.hpp"
+
+namespace floaty
+{
+
+/*
+Runs the preprocess -> parse -> assemble chain like assemble_source(), but keeps its memory from one run to the
+next : the preprocessed text, the directives and their strings, the symbol table arena and the image buffer.
+Once it has seen a program of a given size, assembling programs up to that size mostly allocates inside
+Boost.Wave only. Meant for services assembling many small programs back to back, one context per thread.
+*/
+class AssemblerContext
+{
+public:
+    AssemblerContext() = default;
+
+    AssemblerContext(const AssemblerContext&) = delete;
+    AssemblerContext& operator=(const AssemblerContext&) = delete;
+
+    // Assembles 'source' into the context's image buffer, the result is valid until the next run. Throws on error.
+    gsl::span<const uint8_t> assemble(std::string_view source, const std::string& filename,
+                                      const PreprocessOptions& options = {});
+    void assemble(std::string_view source, const std::string& filename, const PreprocessOptions& options,
+                  OutputSink& sink, ImageStats* stats = nullptr);
+
+    // The directives of the last run, valid until the next one
+    gsl::span<const AssemblerDirective> directives() const
+    {
+        return gsl::make_span(parse_scratch.directives.data(), directive_count);
+    }
+
+    // Forgets the last run, keeps the memory. Every run starts with it.
+    void reset();
+
+private:
+    std::vector<size_t> comments;
+    std::string preprocessed;
+    ParseScratch parse_scratch;
+    size_t directive_count { 0 };
+    Arena symbols;
+    VectorSink image;
+};
+
+}
+
+#endif // ASSEMBLER_CONTEXT_HPP
@@ -0,0 +1,110 @@
+/*
+build_cache.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef BUILD_CACHE_HPP
+#define BUILD_CACHE_HPP
+
+#include <cstdint>
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <optional>
+
+#include <gsl/gsl_span.hpp>
+
+#include "preprocessor.hpp"
+#include "cache_backend.hpp"
+
+namespace floaty
+{
+
+// Identifies the assembler build, part of every cache key
+const char* build_id();
+
+// Hex SHA-1 of everything that can influence the assembled image
+// 'variant' tells apart the different files built from the same image, it is empty for the flat image
+// 'prelude' is the digest of the precompiled header the source is preprocessed with, if any
+std::string compute_cache_key(std::string_view main_source, const std::string& filename,
+                              const std::vector<std::string>& defines,
+                              const std::vector<IncludedFile>& included_files,
+                              std::string_view variant = {}, std::string_view prelude = {});
+
+/*
+On-disk cache of assembled images, addressed by compute_cache_key().
+Layout of the cache directory :
+    objects/xx/yyyy...   one file per image, named after its key
+    tmp/                 entries being written, renamed into objects/ once complete
+    stats                hit, miss and size counters
+    lock                 flock()ed while updating the counters or evicting
+Entries are published with rename() so readers never see partial images, and every hit refreshes the entry's
+mtime : once the cache grows past its size limit the least recently used entries are removed first.
+Any number of processes can share the same directory.
+*/
+class BuildCache : public CacheBackend
+{
+public:
+    struct Stats
+    {
+        uint64_t hits { 0 };
+        uint64_t misses { 0 };
+        uint64_t size { 0 };
+    };
+
+    BuildCache(std::string directory, uint64_t max_size);
+
+    CachedImage lookup(const std::string& key);
+    void store(const std::string& key, gsl::span<const uint8_t> data);
+
+    // The local cache answers right away
+    std::future<CachedImage> get(const std::string& key) override;
+    void put(const std::string& key, gsl::span<const uint8_t> data) override;
+
+    Stats stats() const;
+
+    const std::string& path() const
+    {
+        return directory;
+    }
+
+private:
+    std::string object_path(const std::string& key) const;
+
+    template <typename Func>
+    void update_stats(Func&& func);
+    void evict(Stats& stats);
+
+    std::string directory;
+    uint64_t max_size;
+};
+
+// Writes 'data' to a file of 'tmp_dir' and renames it to 'path', so that readers never see it partially written
+void write_file_atomically(const std::string& path, const std::string& tmp_dir, gsl::span<const uint8_t> data);
+
+// Parses sizes such as "4096", "512K", "64M" or "2G"
+uint64_t parse_cache_size(const std::string& str);
+
+}
+
+#endif // BUILD_CACHE_HPP
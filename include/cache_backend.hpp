@@ -0,0 +1,57 @@
+/*
+cache_backend.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef CACHE_BACKEND_HPP
+#define CACHE_BACKEND_HPP
+
+#include <cstdint>
+
+#include <future>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <gsl/gsl_span.hpp>
+
+namespace floaty
+{
+
+// Empty on a cache miss
+using CachedImage = std::optional<std::vector<uint8_t>>;
+
+// Storage for assembled images, addressed by compute_cache_key()
+class CacheBackend
+{
+public:
+    virtual ~CacheBackend() = default;
+
+    // Starts a lookup, several lookups can be in flight at the same time
+    virtual std::future<CachedImage> get(const std::string& key) = 0;
+    // Best effort, failures are ignored
+    virtual void put(const std::string& key, gsl::span<const uint8_t> data) = 0;
+};
+
+}
+
+#endif // CACHE_BACKEND_HPP
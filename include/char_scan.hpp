@@ -0,0 +1,45 @@
+/*
+char_scan.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#ifndef CHAR_SCAN_HPP
+#define CHAR_SCAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+namespace floaty
+{
+
+constexpr size_t scan_block_size = 64;
+
+// Bit i is set if block[i] is one of the characters pre_preprocess() stops at : '"', ';', '/' or '\n'.
+// 'block' must have scan_block_size readable bytes. Uses AVX2 or SSE2 when the CPU has them.
+uint64_t scan_block(const char* block);
+// Same, for the last 'size' (< scan_block_size) bytes of the input
+uint64_t scan_tail(const char* data, size_t size);
+
+}
+
+#endif // CHAR_SCAN_HPP
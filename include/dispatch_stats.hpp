@@ -0,0 +1,94 @@
+/*
+dispatch_stats.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef DISPATCH_STATS_HPP
+#define DISPATCH_STATS_HPP
+
+#include <cstdint>
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace floaty
+{
+
+/*
+Counters of the opcode dispatch of the assembler : for each instruction, how many entries of the opcode table it
+was matched against before one accepted it, how many numeric conversions that took, and so on. Only maintained
+when the assembler is configured with -DFLOATY_DISPATCH_STATS=ON, the hooks compile to nothing otherwise.
+*/
+#ifdef FLOATY_DISPATCH_STATS
+constexpr bool dispatch_stats_enabled = true;
+#else
+constexpr bool dispatch_stats_enabled = false;
+#endif
+
+struct DispatchCounters
+{
+    uint64_t instructions { 0 };
+    // opcode table entries the instructions were matched against
+    uint64_t probes { 0 };
+    // probes whose mnemonic matched, which then classified the operands
+    uint64_t operand_checks { 0 };
+    // strtol, std::stol and std::stoi calls, while matching and encoding
+    uint64_t conversions { 0 };
+    // probes that read "<op> rx, ry" as "<op> rx, rx, ry"
+    uint64_t fallbacks { 0 };
+    // instructions no opcode accepted
+    uint64_t unmatched { 0 };
+
+    DispatchCounters& operator+=(const DispatchCounters& other);
+};
+
+// Numeric conversions run by the calling thread so far
+inline uint64_t& thread_numeric_conversions()
+{
+    thread_local uint64_t conversions { 0 };
+    return conversions;
+}
+
+inline void count_numeric_conversions(uint64_t count = 1)
+{
+    if constexpr (dispatch_stats_enabled) thread_numeric_conversions() += count;
+}
+
+// Adds the dispatch of one instruction, safe to call from any thread
+void record_dispatch(std::string_view mnemonic, const DispatchCounters& counters);
+
+struct DispatchReport
+{
+    DispatchCounters total;
+    // by decreasing number of probes
+    std::vector<std::pair<std::string, DispatchCounters>> mnemonics;
+};
+
+DispatchReport dispatch_report();
+void print_dispatch_report(const DispatchReport& report, std::ostream& stream);
+
+}
+
+#endif // DISPATCH_STATS_HPP
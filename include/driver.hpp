@@ -0,0 +1,129 @@
+/*
+driver.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef DRIVER_HPP
+#define DRIVER_HPP
+
+#include <cstdint>
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <optional>
+
+#include <gsl/gsl_span.hpp>
+
+#include "preprocessor.hpp"
+#include "assembler.hpp"
+#include "build_cache.hpp"
+#include "cache_backend.hpp"
+#include "output_file.hpp"
+
+namespace floaty
+{
+
+struct Job
+{
+    std::string input;
+    std::string output;
+    std::vector<std::string> defines;
+};
+
+struct JobResult
+{
+    // 0 on success, otherwise the exit code the command line front end reports
+    int status { 0 };
+    std::string message;
+    // with JobServices::collect_stats, unless the image came from the cache
+    std::optional<ImageStats> stats;
+};
+
+// Services shared between jobs, all optional
+struct JobServices
+{
+    IncludeLoader* loader { nullptr };
+    // replays the tokens of the included files lexed by earlier jobs or runs
+    TokenCache* token_cache { nullptr };
+    // every job is preprocessed as if it started by including this header, see precompiled_header.hpp
+    const PrecompiledHeader* prelude { nullptr };
+    CacheBackend* cache { nullptr };
+    // how long a job waits for a cache answer before assembling the source itself
+    std::chrono::milliseconds cache_timeout { 250 };
+    OutputFormat output_format { OutputFormat::Sparse };
+    // fill JobResult::stats of the jobs that assemble their image
+    bool collect_stats { false };
+    // assemble the jobs that don't use a cache with assemble_source_pipelined()
+    bool pipeline { false };
+};
+
+struct PipelineOptions
+{
+    // preprocessed text handed from the preprocessor to the parser at once, rounded up to a whole line
+    size_t chunk_size { 64 * 1024 };
+    // chunks, then directive batches, a stage can get ahead of the next one by
+    size_t queue_depth { 8 };
+};
+
+// Runs pre_preprocess and preprocess on 'source', throws on error
+std::string preprocess_source(std::string_view source, const std::string& filename, const PreprocessOptions& options);
+// Runs parse and assemble on preprocessed text, throws on error
+void assemble_preprocessed(std::string_view preprocessed, const std::string& filename, OutputSink& sink,
+                           ImageStats* stats = nullptr);
+std::vector<uint8_t> assemble_preprocessed(std::string_view preprocessed, const std::string& filename);
+
+// Runs the whole preprocess -> parse -> assemble chain on 'source', throws on error. The preprocessed text is handed
+// to the parser line by line instead of being stored.
+void assemble_source(std::string_view source, const std::string& filename, const PreprocessOptions& options,
+                     OutputSink& sink, ImageStats* stats = nullptr);
+std::vector<uint8_t> assemble_source(std::string_view source, const std::string& filename, const PreprocessOptions& options);
+
+// Same as assemble_source(), with preprocess, parse and the first assembler pass running at the same time on
+// their own threads, linked by bounded queues. Encoding starts once the whole program has been laid out.
+// Gives the same image, stats and errors as assemble_source().
+void assemble_source_pipelined(std::string_view source, const std::string& filename, const PreprocessOptions& options,
+                               OutputSink& sink, ImageStats* stats = nullptr, const PipelineOptions& pipeline = {});
+
+void write_output(const std::string& filename, gsl::span<const uint8_t> data);
+
+// Calls 'func' and turns the exceptions it throws into the matching JobResult, 'func' returns the success message
+JobResult run_guarded(const std::function<std::string()>& func);
+
+// Assembles 'job.input' into 'job.output', never throws
+// When a cache is given, parse and assemble only run if no image is cached for the preprocessed input
+JobResult run_job(const Job& job, const JobServices& services = {});
+
+// Precompiles the header 'job.input' with 'job.defines' into 'job.output', never throws. Only the loader and the
+// token cache of 'services' are used.
+JobResult run_precompile_job(const Job& job, const JobServices& services = {});
+
+// Runs every job on a work-stealing pool, results are returned in the order of 'jobs'
+std::vector<JobResult> run_batch(gsl::span<const Job> jobs, size_t thread_count, JobServices services = {});
+
+// One job per line : "<input_file> <output_file>", blank lines and lines starting with '#' are ignored
+std::vector<Job> read_manifest(const std::string& filename);
+
+}
+
+#endif // DRIVER_HPP
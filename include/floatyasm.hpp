@@ -0,0 +1,122 @@
+/*
+floatyasm.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef FLOATYASM_HPP
+#define FLOATYASM_HPP
+
+#include <cstdint>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "assembler.hpp"
+#include "assembler_context.hpp"
+#include "preprocessor.hpp"
+#include "token_cache.hpp"
+
+/*
+Public API of libfloatyasm : assembles source text held in memory, without going through files.
+Every call is independent, so any number of threads can assemble at the same time, as long as they don't
+share a VirtualFileSystem that is still being filled.
+*/
+
+namespace floaty
+{
+
+// Include files held in memory, keyed by their path.
+// An #include "name" is looked up next to the including file first, then from the root of the filesystem.
+// Names that are not found go to 'fallback' if one is given, otherwise they can't be included.
+class VirtualFileSystem : public IncludeLoader
+{
+public:
+    explicit VirtualFileSystem(IncludeLoader* fallback = nullptr)
+        : fallback(fallback)
+    {}
+
+    void add_file(const std::string& filename, std::string contents);
+
+    std::shared_ptr<const std::string> load(const std::string& filename) override;
+    bool locate(const std::string& name, const std::string& includer, std::string& resolved) override;
+
+private:
+    IncludeLoader* fallback;
+    std::map<std::string, std::shared_ptr<const std::string>> files;
+};
+
+struct Diagnostic
+{
+    enum class Kind
+    {
+        Io,
+        Preprocessor,
+        Assembler,
+        Internal
+    };
+
+    Kind kind;
+    std::string message;
+};
+
+struct AssembleOptions
+{
+    // name of the source in diagnostics and __FILE__, relative includes are resolved from its directory
+    std::string filename { "<input>" };
+    // "NAME" or "NAME=VALUE", as with -D
+    std::vector<std::string> defines;
+    // where #include finds its files, the disk if null
+    IncludeLoader* includes { nullptr };
+    // if set, included files are lexed once and replayed from it afterwards, see token_cache.hpp
+    TokenCache* token_cache { nullptr };
+    // if set, the source starts as if it included the header, see precompiled_header.hpp
+    const PrecompiledHeader* prelude { nullptr };
+    // if set, the memory of the previous calls made with it is reused, see assembler_context.hpp
+    AssemblerContext* context { nullptr };
+    // filled with the statistics of the image if set, see image_stats.hpp
+    ImageStats* stats { nullptr };
+};
+
+struct AssembleResult
+{
+    bool success() const
+    {
+        return diagnostics.empty();
+    }
+
+    // the flat image, empty on failure or when assembling into a caller's sink
+    std::vector<uint8_t> image;
+    std::vector<Diagnostic> diagnostics;
+    // every file pulled in by #include, in inclusion order
+    std::vector<std::string> included_files;
+};
+
+// Assembles 'source', never throws : failures are reported as diagnostics
+AssembleResult assemble_text(std::string_view source, const AssembleOptions& options = {});
+AssembleResult assemble_text(std::string_view source, const AssembleOptions& options, OutputSink& sink);
+
+}
+
+#endif // FLOATYASM_HPP
@@ -0,0 +1,72 @@
+/*
+hasher.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef HASHER_HPP
+#define HASHER_HPP
+
+#include <cstdint>
+
+#include <string>
+#include <string_view>
+
+#include <boost/uuid/detail/sha1.hpp>
+
+namespace floaty
+{
+
+// SHA-1 of a sequence of strings, each one prefixed with its size so that the boundaries count
+class Hasher
+{
+public:
+    void add(std::string_view data)
+    {
+        uint64_t size = data.size();
+        sha1.process_bytes(&size, sizeof(size));
+        sha1.process_bytes(data.data(), data.size());
+    }
+
+    std::string hex_digest()
+    {
+        boost::uuids::detail::sha1::digest_type digest;
+        sha1.get_digest(digest);
+
+        static constexpr char hex_chars[] = "0123456789abcdef";
+        std::string result;
+        for (auto word : digest)
+        {
+            for (int shift { 28 }; shift >= 0; shift -= 4)
+            {
+                result += hex_chars[(word >> shift) & 0xF];
+            }
+        }
+        return result;
+    }
+
+private:
+    boost::uuids::detail::sha1 sha1;
+};
+
+}
+
+#endif // HASHER_HPP
@@ -0,0 +1,79 @@
+/*
+image_stats.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef IMAGE_STATS_HPP
+#define IMAGE_STATS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+#include <map>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace floaty
+{
+
+// How often an entry of opcodes.def was encoded
+struct OpcodeUse
+{
+    std::string_view pattern;
+    std::string_view format;
+    std::string_view mnemonic;
+    uint64_t count { 0 };
+};
+
+// What an image is made of, collected by assemble() while it encodes, see assembler.hpp
+struct ImageStats
+{
+    // in opcodes.def order, unused opcodes are left out
+    std::vector<OpcodeUse> opcodes;
+    uint64_t instructions { 0 };
+    uint64_t code_bytes { 0 };
+    // bytes inserted by the DB, DW, DD and DS directives, by directive
+    std::map<std::string, uint64_t> data_bytes;
+    uint64_t seeks { 0 };
+    // bytes SEEK jumped over, zero fill in the image
+    uint64_t seek_skipped_bytes { 0 };
+    // DUP directives run, their repetitions and the bytes they produced
+    uint64_t dups { 0 };
+    uint64_t dup_repetitions { 0 };
+    uint64_t dup_max_repetitions { 0 };
+    uint64_t dup_bytes { 0 };
+    uint64_t labels { 0 };
+    // address of the last byte written, none if the program wrote nothing
+    std::optional<size_t> highest_address;
+    // trailing SEEKs can make the image larger than highest_address + 1
+    size_t image_size { 0 };
+};
+
+// Writes 'stats' as a JSON object without a trailing newline, with an "input" field first if 'input' isn't empty
+void print_image_stats_json(const ImageStats& stats, std::ostream& stream, std::string_view input = {});
+
+}
+
+#endif // IMAGE_STATS_HPP
@@ -0,0 +1,71 @@
+/*
+include_cache.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef INCLUDE_CACHE_HPP
+#define INCLUDE_CACHE_HPP
+
+#include <ctime>
+
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#include "preprocessor.hpp"
+
+namespace floaty
+{
+
+// Keeps the most recently included files in memory.
+// Entries are checked against the file size and modification time on every lookup, and the least
+// recently used ones are dropped once 'max_bytes' is exceeded. Safe to share between threads.
+class IncludeCache : public IncludeLoader
+{
+public:
+    explicit IncludeCache(size_t max_bytes = 64*1024*1024)
+        : max_bytes(max_bytes)
+    {}
+
+    std::shared_ptr<const std::string> load(const std::string& filename) override;
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const std::string> contents;
+        off_t size { 0 };
+        timespec mtime {};
+        std::list<std::string>::iterator lru_pos;
+    };
+
+    void evict();
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    std::list<std::string> lru; // most recently used first
+    size_t max_bytes;
+    size_t total_bytes { 0 };
+};
+
+}
+
+#endif // INCLUDE_CACHE_HPP
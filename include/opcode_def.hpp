@@ -30,8 +30,10 @@ SOFTWARE.
 
 #include <string_view>
 #include <array>
+#include <tuple>
 
 #include "operand.hpp"
+#include "opcode_table.hpp"
 
 #include "opcode_utils.hpp"
 #include "type_utils.hpp"
@@ -89,23 +91,7 @@ public:
 
     static constexpr uint32_t base()
     {
-        uint32_t base { 0 };
-        for (size_t i { 0 }; i < const_strlen<Pattern>(); ++i)
-        {
-            base <<= 4;
-            if (isxdigit(Pattern[i]))
-            {
-                if (isalpha(Pattern[i]))
-                {
-                    base |= tolower(Pattern[i]) - 'a' + 0xa;
-                }
-                else
-                {
-                    base |= Pattern[i] - '0';
-                }
-            }
-        }
-        return base;
+        return get_opcode_base({Pattern, const_strlen<Pattern>()});
     }
 
     static constexpr uint32_t mask()
@@ -126,6 +112,29 @@ public:
     static_assert(mask() != 0xFFFFFF);
 };
 
+// The opcode table entry of 'Opcode'
+template <typename Opcode>
+constexpr OpcodeDesc describe_opcode()
+{
+    OpcodeDesc desc;
+    desc.pattern = {Opcode::Pattern, const_strlen<Opcode::Pattern>()};
+    desc.format = {Opcode::MnemoFmt, const_strlen<Opcode::MnemoFmt>()};
+    desc.mnemonic = Opcode::mnemonic();
+    desc.base = Opcode::base();
+    desc.offset_shift = Opcode::template operand_offset<'n'>() * 4;
+    desc.operand_count = Opcode::operand_count();
+
+    std::apply([&desc](auto... operands)
+    {
+        [[maybe_unused]] size_t i { 0 };
+        ((desc.operands[i++] = OperandDesc {decltype(operands)::type(),
+              uint8_t(Opcode::template operand_offset<decltype(operands)::operand_char()>() * 4),
+              uint8_t(Opcode::template operand_offset<decltype(operands)::indexed_breg_char()>() * 4)}), ...);
+    }, Opcode::operands());
+
+    return desc;
+}
+
 }
 
 #endif // OPCODE_HPP
@@ -0,0 +1,353 @@
+/*
+opcode.hpp
+
+Copyright (c) 04 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef OPCODE_TABLE_HPP
+#define OPCODE_TABLE_HPP
+
+#include <cstdint>
+#include <cstddef>
+
+#include <array>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "operand.hpp"
+
+namespace floaty
+{
+
+constexpr size_t max_operand_count = 6;
+
+struct OperandDesc
+{
+    OperandType type { OperandType::Invalid };
+    // bit position of the register or immediate of the operand in the opcode
+    uint8_t shift { 0 };
+    // bit position of the B register of a [Ix+By+n] operand
+    uint8_t breg_shift { 0 };
+};
+
+// Everything needed to match and encode one entry of opcodes.def
+struct OpcodeDesc
+{
+    // as written in opcodes.def
+    std::string_view pattern;
+    std::string_view format;
+    std::string_view mnemonic;
+    uint32_t base { 0 };
+    // bit position of the n offset of indexed operands
+    uint8_t offset_shift { 0 };
+    uint8_t operand_count { 0 };
+    std::array<OperandDesc, max_operand_count> operands { };
+};
+
+/*
+Plain constexpr functions computing the same descriptions as the Opcode and Operand templates of opcode_def.hpp
+and operand.hpp, without instantiating anything per opcode. They mirror the template versions, quirks included,
+so both generate identical tables.
+An invalid entry makes the evaluation reach a throw, which fails the constant expression and shows the message in
+the compiler error.
+*/
+
+constexpr size_t const_find(std::string_view str, size_t off, char c)
+{
+    for (size_t i { off }; i < str.size(); ++i)
+    {
+        if (str[i] == c) return i - off;
+    }
+
+    return const_npos;
+}
+
+constexpr size_t const_find_first_not(std::string_view str, size_t off, char c)
+{
+    for (size_t i { off }; i < str.size(); ++i)
+    {
+        if (str[i] != c) return i - off;
+    }
+
+    return const_npos;
+}
+
+constexpr size_t const_count(std::string_view str, size_t off, char c)
+{
+    size_t count { 0 };
+    for (size_t i { off }; i < str.size(); ++i)
+    {
+        if (str[i] == c) ++count;
+    }
+
+    return count;
+}
+
+constexpr bool const_starts_with(std::string_view str, size_t off, std::string_view prefix)
+{
+    if (off + prefix.size() > str.size()) return false;
+
+    for (size_t i { 0 }; i < prefix.size(); ++i)
+    {
+        if (str[off + i] != prefix[i]) return false;
+    }
+
+    return true;
+}
+
+constexpr bool check_pattern(std::string_view pattern)
+{
+    if (pattern.size() != 6)
+    {
+        throw std::invalid_argument("The opcode pattern must have a length of 6 chars (24-bit)");
+    }
+    for (char c : pattern)
+    {
+        if (const_find(opcode_char_list, 0, c) == const_npos)
+        {
+            throw std::invalid_argument("The opcode pattern must be made of the following : \"0123456789ABCDEFabcdef_xyzwn\"");
+        }
+    }
+
+    return true;
+}
+
+constexpr std::string_view get_mnemo(std::string_view mnemo_fmt)
+{
+    const size_t len = const_find(mnemo_fmt, 0, ' ');
+    return mnemo_fmt.substr(0, len == const_npos ? mnemo_fmt.size() : len);
+}
+
+constexpr bool check_mnemo_fmt(std::string_view format)
+{
+    if (format.empty())
+    {
+        throw std::invalid_argument("The mnemonic format musn't be empty !");
+    }
+    for (char c : get_mnemo(format))
+    {
+        if (!const_isupper(c)) throw std::invalid_argument("The mnemonic must be uppercase");
+    }
+
+    return true;
+}
+
+constexpr size_t operand_count(std::string_view mnemo_fmt)
+{
+    size_t i { 0 };
+    while (i < mnemo_fmt.size() && !const_isspace(mnemo_fmt[i])) ++i; // skip the mnemo
+    if (i == mnemo_fmt.size()) return 0;
+    while (i < mnemo_fmt.size() && const_isspace(mnemo_fmt[i]))  ++i; // skip the spaces after the mnemo
+
+    size_t count { 1 };
+
+    for (; i < mnemo_fmt.size(); ++i)
+    {
+        if (mnemo_fmt[i] == ',') ++count;
+    }
+
+    return count;
+}
+
+constexpr size_t get_operand_offset(std::string_view mnemo_fmt, size_t idx)
+{
+    size_t i { 0 };
+    size_t op_idx { 0 };
+    while (!const_isspace(mnemo_fmt[i])) ++i; // skip the mnemo
+    while (const_isspace(mnemo_fmt[i]))  ++i; // skip the spaces after the mnemo
+
+    while (op_idx != idx)
+    {
+        while (i < mnemo_fmt.size() && mnemo_fmt[i] != ',') ++i;
+        if (mnemo_fmt[i] == ',') ++i; // skip the comma
+        ++op_idx;
+    }
+
+    return i;
+}
+
+// Offset and length of operand 'idx' in 'mnemo_fmt', as get_operand<>().trim() computes them
+constexpr std::pair<size_t, size_t> get_operand_span(std::string_view mnemo_fmt, size_t idx)
+{
+    const size_t base = get_operand_offset(mnemo_fmt, idx);
+    const size_t comma = const_find(mnemo_fmt, base, ',');
+    const size_t length = comma != const_npos ? comma : mnemo_fmt.size() - base;
+
+    const size_t first = const_find_first_not(mnemo_fmt, base, ' ');
+    const size_t left_offset_tmp = first != const_npos ? first : 0;
+    const size_t left_offset = mnemo_fmt[base + left_offset_tmp] == ',' ? left_offset_tmp - 1 : left_offset_tmp;
+
+    const size_t space = const_find(mnemo_fmt, base + left_offset, ' ');
+    const size_t length_tmp = space != const_npos ? space - left_offset : length - left_offset;
+    // Remove trailing comma
+    const size_t trimmed = mnemo_fmt[base + left_offset - 1 + length_tmp] == ',' ? length_tmp - 1 : length_tmp;
+
+    return {base + left_offset, trimmed};
+}
+
+// The type of the operand at 'offset' in 'mnemo_fmt', see Operand::type_impl()
+constexpr OperandType get_operand_type(std::string_view mnemo_fmt, size_t offset, size_t length)
+{
+    const char first = mnemo_fmt[offset];
+    if (length == 1 && (first == 'n' || first == 'x' || first == 'y' || first == 'z' || first == 'w'))
+    {
+        return OperandType::ByteImmediate;
+    }
+    if (const_starts_with(mnemo_fmt, offset, addr_str)) return OperandType::Address;
+    if (const_starts_with(mnemo_fmt, offset, indir_addr_str)) return OperandType::IndirectAddr;
+    if (const_starts_with(mnemo_fmt, offset, st_str)) return OperandType::SoundTimer;
+    if (const_starts_with(mnemo_fmt, offset, dt_str)) return OperandType::DelayTimer;
+    if (const_starts_with(mnemo_fmt, offset, sp_str)) return OperandType::StackPointer;
+    if (const_starts_with(mnemo_fmt, offset, b_indir_str)) return OperandType::BIndirectReg;
+    if (const_starts_with(mnemo_fmt, offset, i_indir_str)) return OperandType::IIndirectReg;
+    if (const_starts_with(mnemo_fmt, offset, i_addr_indir_beg_str) &&
+        const_starts_with(mnemo_fmt, offset + 3, i_addr_indir_end_str))
+    {
+        return OperandType::IndirectIRegPlusN;
+    }
+    if (const_starts_with(mnemo_fmt, offset, i_addr_indir_beg_str) &&
+        const_starts_with(mnemo_fmt, offset + 3, i_b_addr_indir_mid_str) &&
+        const_starts_with(mnemo_fmt, offset + 6, i_addr_indir_end_str))
+    {
+        return OperandType::IndirectIRegPlusBRegPlusN;
+    }
+    if (length == 2)
+    {
+        switch (first)
+        {
+            case 'N':
+                return OperandType::NReg;
+            case 'B':
+                return OperandType::BReg;
+            case 'I':
+                return OperandType::IReg;
+        }
+    }
+    else if (length == 4 && const_starts_with(mnemo_fmt, offset, i_addr_indir_beg_str))
+    {
+        return OperandType::IndirectIReg;
+    }
+    return OperandType::Invalid;
+}
+
+// The char of the pattern holding the operand, see Operand::operand_char()
+constexpr char get_operand_char(std::string_view mnemo_fmt, size_t offset, OperandType type)
+{
+    switch (type)
+    {
+        case OperandType::ByteImmediate:
+            return mnemo_fmt[offset];
+        case OperandType::NReg:
+        case OperandType::BReg:
+        case OperandType::IReg:
+            return mnemo_fmt[offset + 1];
+        case OperandType::BIndirectReg:
+        case OperandType::IIndirectReg:
+            return mnemo_fmt[offset + 3];
+        case OperandType::IndirectIRegPlusN:
+        case OperandType::IndirectIRegPlusBRegPlusN:
+            return mnemo_fmt[offset + 2];
+        default:
+            return '\0';
+    }
+}
+
+// See Opcode::operand_offset(), in bits
+constexpr uint8_t get_operand_shift(std::string_view pattern, char c)
+{
+    return uint8_t(5 - const_find(pattern, 0, c)) * 4;
+}
+
+constexpr uint32_t get_opcode_base(std::string_view pattern)
+{
+    uint32_t base { 0 };
+    for (char c : pattern)
+    {
+        base <<= 4;
+        if (c >= '0' && c <= '9') base |= c - '0';
+        else if (c >= 'a' && c <= 'f') base |= c - 'a' + 0xa;
+        else if (c >= 'A' && c <= 'F') base |= c - 'A' + 0xa;
+    }
+    return base;
+}
+
+constexpr uint32_t get_opcode_mask(std::string_view pattern)
+{
+    uint32_t mask { 0 };
+    for (char c : pattern)
+    {
+        mask <<= 4;
+        if (c == '_' || c == 'x' || c == 'y' || c == 'z' || c == 'n')
+        {
+            mask |= 0xF;
+        }
+    }
+    return mask;
+}
+
+constexpr OpcodeDesc make_opcode_desc(std::string_view pattern, std::string_view mnemo_fmt)
+{
+    check_pattern(pattern);
+    check_mnemo_fmt(mnemo_fmt);
+    if (get_opcode_mask(pattern) == 0xFFFFFF)
+    {
+        throw std::invalid_argument("The opcode pattern must have at least one fixed digit");
+    }
+
+    OpcodeDesc desc;
+    desc.pattern = pattern;
+    desc.format = mnemo_fmt;
+    desc.mnemonic = get_mnemo(mnemo_fmt);
+    desc.base = get_opcode_base(pattern);
+    desc.offset_shift = get_operand_shift(pattern, 'n');
+
+    const size_t count = operand_count(mnemo_fmt);
+    if (count > max_operand_count) throw std::invalid_argument("Too many operands");
+    desc.operand_count = count;
+
+    for (size_t i { 0 }; i < count; ++i)
+    {
+        const auto [offset, length] = get_operand_span(mnemo_fmt, i);
+        if (const_count(mnemo_fmt, offset, '[') != const_count(mnemo_fmt, offset, ']'))
+        {
+            throw std::invalid_argument("Unmatched bracket found");
+        }
+        if (const_count(mnemo_fmt, offset, '(') != const_count(mnemo_fmt, offset, ')'))
+        {
+            throw std::invalid_argument("Unmatched parenthesis found");
+        }
+
+        auto& operand = desc.operands[i];
+        operand.type = get_operand_type(mnemo_fmt, offset, length);
+        if (operand.type == OperandType::Invalid) throw std::invalid_argument("Invalid operand type");
+
+        operand.shift = get_operand_shift(pattern, get_operand_char(mnemo_fmt, offset, operand.type));
+        operand.breg_shift = get_operand_shift(pattern, operand.type == OperandType::IndirectIRegPlusBRegPlusN
+                                                        ? mnemo_fmt[offset + 5] : '\0');
+    }
+
+    return desc;
+}
+
+}
+
+#endif // OPCODE_TABLE_HPP
@@ -259,14 +259,22 @@ inline bool is_string(std::string_view str)
 
 inline bool is_immediate(std::string_view str)
 {
-    return is_number(std::string(str))
-            && std::stol(std::string(str), nullptr, 0) >= -127 && std::stol(std::string(str), nullptr, 0) <= 255;
+    if (!is_number(std::string(str))) return false;
+
+    count_numeric_conversions();
+    if (std::stol(std::string(str), nullptr, 0) < -127) return false;
+    count_numeric_conversions();
+    return std::stol(std::string(str), nullptr, 0) <= 255;
 }
 
 inline bool is_signed_immediate(std::string_view str)
 {
-    return is_number(std::string(str))
-            && std::stol(std::string(str), nullptr, 0) >= -127 && std::stol(std::string(str), nullptr, 0) <= 127;
+    if (!is_number(std::string(str))) return false;
+
+    count_numeric_conversions();
+    if (std::stol(std::string(str), nullptr, 0) < -127) return false;
+    count_numeric_conversions();
+    return std::stol(std::string(str), nullptr, 0) <= 127;
 }
 
 inline bool is_address(std::string_view str)
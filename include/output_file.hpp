@@ -0,0 +1,104 @@
+/*
+output_file.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef OUTPUT_FILE_HPP
+#define OUTPUT_FILE_HPP
+
+#include <string>
+#include <vector>
+
+#include "assembler.hpp"
+
+namespace floaty
+{
+
+enum class OutputFormat
+{
+    // The flat image, the gaps left by SEEK are holes in the file
+    Sparse,
+    // The flat image, the gaps are written out as zeroes
+    Flat,
+    // Segment container, all fields are little-endian 32 bit integers :
+    //     "FCSG" <version = 1> <image size> <segment count>
+    //     <address> <size>          for each segment
+    //     the bytes of every segment, back to back
+    Segments
+};
+
+// Parses "sparse", "flat" or "segments"
+OutputFormat parse_output_format(const std::string& str);
+const char* output_format_name(OutputFormat format);
+
+// Output file the assembler encodes into.
+// Sparse images going to regular files are encoded straight into a mapping of a temporary file created next to
+// the destination, commit() then renames it over the destination : nothing is written to 'filename' if assembly
+// fails. Only the pages holding segments are ever touched, the gaps stay holes. A symlink is followed to the file
+// it points to, which keeps its permissions.
+// Otherwise only the segments are kept in memory and commit() writes the requested format out.
+class OutputFile : public OutputSink
+{
+public:
+    explicit OutputFile(std::string filename, OutputFormat format = OutputFormat::Sparse);
+    ~OutputFile() override;
+
+    OutputFile(const OutputFile&) = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    gsl::span<uint8_t> allocate(size_t size) override;
+    std::vector<gsl::span<uint8_t>> allocate_segments(const ImageLayout& layout) override;
+
+    // The mapped image, only valid if is_mapped() and until commit()
+    gsl::span<const uint8_t> data() const
+    {
+        return image;
+    }
+
+    // What commit() writes to the file
+    std::vector<uint8_t> contents() const;
+
+    void commit();
+
+    bool is_mapped() const
+    {
+        return mapping != nullptr;
+    }
+
+private:
+    bool map(const ImageLayout& layout);
+    void release();
+
+    std::string filename;
+    OutputFormat format;
+    // 'filename' with its symlinks resolved, where the temporary file is renamed to
+    std::string target_filename;
+    std::string tmp_filename;
+    int fd { -1 };
+    void* mapping { nullptr };
+    gsl::span<uint8_t> image;
+    SegmentSink segments;
+};
+
+}
+
+#endif // OUTPUT_FILE_HPP
@@ -26,8 +26,12 @@ SOFTWARE.
 #define PARSER_HPP
 
 #include "assembler.hpp"
+#include "preprocessor.hpp"
 
+#include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 #include <stdexcept>
 
 namespace floaty
@@ -45,6 +49,53 @@ struct parser_error : std::runtime_error
 
 std::vector<AssemblerDirective> parse(std::string_view input, std::string_view filename);
 
+// Memory kept from one parse() to the next, see AssemblerContext
+struct ParseScratch
+{
+    // the first parse() results are the directives, the rest are spares whose strings get reused
+    std::vector<AssemblerDirective> directives;
+    std::vector<std::string_view> lines;
+    std::vector<std::string_view> tokens;
+};
+
+// Parses into scratch.directives, overwriting the directives left by the previous call. Returns how many of them
+// 'input' produced.
+size_t parse(std::string_view input, std::string_view filename, ParseScratch& scratch);
+
+// Per-parse state, kept local so several sources can be parsed concurrently
+struct ParserState
+{
+    unsigned line { 1 };
+    std::string filename;
+    std::optional<Label> pending_label;
+};
+
+// Parses a source handed over in chunks, as produced by the chunked preprocess(). Gives the same directives and
+// errors as parse() over the concatenated chunks, provided that every chunk but the last ends with a complete line.
+// Also takes the lines of the line by line preprocess(), which come with their position.
+class IncrementalParser
+{
+public:
+    explicit IncrementalParser(std::string_view filename);
+
+    // Appends the directives of 'chunk' to 'directives'
+    void parse(std::string_view chunk, std::vector<AssemblerDirective>& directives);
+    // Appends the directives of 'lines' to 'directives'
+    void parse(gsl::span<const PreprocessedLine> lines, std::vector<AssemblerDirective>& directives);
+    // Parses what was held back waiting for the rest of a quote, call it once after the last chunk
+    void finish(std::vector<AssemblerDirective>& directives);
+
+private:
+    void parse_lines(std::string_view input, std::vector<AssemblerDirective>& directives);
+
+    ParserState state;
+    std::string pending;
+    bool open_quote { false };
+    std::vector<std::string_view> lines;
+    std::vector<std::string_view> tokens;
+    Instruction ins;
+};
+
 }
 
 #endif // PARSER_HPP
@@ -0,0 +1,66 @@
+/*
+perf_counters.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef PERF_COUNTERS_HPP
+#define PERF_COUNTERS_HPP
+
+#include <cstdint>
+
+#include <array>
+#include <string>
+
+namespace floaty
+{
+
+enum class HardwareEvent
+{
+    Cycles,
+    Instructions,
+    BranchMisses,
+    // misses of the last level cache
+    CacheMisses,
+    Count
+};
+
+const char* hardware_event_name(HardwareEvent event);
+
+using HardwareCounts = std::array<uint64_t, (size_t)HardwareEvent::Count>;
+
+/*
+User space hardware event counts of the calling thread, read from Linux perf events (perf_event_open).
+The counters of a thread are opened the first time it asks for them and stay open until it exits. They can be
+missing altogether in containers and VMs, or when kernel.perf_event_paranoid is above 2, and some events
+can be missing on their own. Missing events count as zero.
+When the kernel has to multiplex the counters, the counts are estimates scaled from the time they ran.
+*/
+HardwareCounts thread_hardware_counts();
+
+// Opens the counters of the calling thread, returns false with an explanation in 'reason' if none can be used
+bool hardware_counters_available(std::string& reason);
+// Whether 'event' could be counted on the calling thread
+bool hardware_event_supported(HardwareEvent event);
+
+}
+
+#endif // PERF_COUNTERS_HPP
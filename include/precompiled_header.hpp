@@ -0,0 +1,104 @@
+/*
+precompiled_header.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef PRECOMPILED_HEADER_HPP
+#define PRECOMPILED_HEADER_HPP
+
+#include <cstdint>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace floaty
+{
+
+// A token of a macro, as Boost.Wave lexed it
+struct PrecompiledToken
+{
+    uint32_t id { 0 };
+    std::string value;
+    // index in PrecompiledHeader::filenames
+    uint32_t file { 0 };
+    uint32_t line { 0 };
+    uint32_t column { 0 };
+};
+
+struct PrecompiledMacro
+{
+    PrecompiledToken name;
+    bool function_like { false };
+    std::vector<PrecompiledToken> parameters;
+    std::vector<PrecompiledToken> definition;
+};
+
+// A file Wave won't include again, because of its #pragma once or its include guard
+struct GuardedFile
+{
+    std::string filename;
+    std::string guard;
+};
+
+// A file the header was built from and the digest of its contents when it was
+struct PrecompiledSource
+{
+    std::string filename;
+    std::string digest;
+};
+
+/*
+The state the preprocessor is left in once a header has been run : every macro defined at the end of the header,
+including the -D ones, and the files it won't include again. preprocess() starts from it instead of running the
+header, as a C compiler does with a precompiled header, so the header is in effect before the first line of the
+input as with -include. Only headers made of directives can be precompiled, the text they would output is lost.
+*/
+struct PrecompiledHeader
+{
+    std::string header;
+    // the -D options it was built with, the inputs using it must be preprocessed with the same ones
+    std::vector<std::string> defines;
+    std::vector<PrecompiledSource> sources;
+    // the file names of the token positions
+    std::vector<std::string> filenames;
+    std::vector<PrecompiledMacro> macros;
+    std::vector<GuardedFile> guarded_files;
+    // identifies the header, its sources and defines, for the cache keys of the inputs using it
+    std::string digest;
+};
+
+// Digest of the contents of a source of a precompiled header
+std::string source_digest(std::string_view contents);
+// Computes PrecompiledHeader::digest out of the header, its defines and sources
+std::string precompiled_header_digest(const PrecompiledHeader& header);
+
+// Throws io_error if the file can't be written
+void save_precompiled_header(const PrecompiledHeader& header, const std::string& path);
+// Throws io_error if the file can't be read or is malformed
+PrecompiledHeader load_precompiled_header(const std::string& path);
+// Throws io_error if one of the sources of 'header' changed since it was built
+void check_precompiled_header(const PrecompiledHeader& header);
+
+}
+
+#endif // PRECOMPILED_HEADER_HPP
@@ -25,9 +25,17 @@ SOFTWARE.
 #ifndef PREPROCESSOR_HPP
 #define PREPROCESSOR_HPP
 
+#include <functional>
 #include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
 #include <stdexcept>
 
+#include <gsl/gsl_span.hpp>
+
+#include "precompiled_header.hpp"
+
 namespace floaty
 {
 
@@ -41,8 +49,84 @@ struct pp_error : std::runtime_error
     throw pp_error("Preprocessor error : " + why);
 }
 
-void pre_preprocess(std::string& input);
-std::string preprocess(std::string_view input, std::string_view filename);
+// Provides the contents of the files pulled in by #include, the default implementation reads them from disk
+class IncludeLoader
+{
+public:
+    virtual ~IncludeLoader() = default;
+
+    // Returns nullptr if the file can't be read
+    virtual std::shared_ptr<const std::string> load(const std::string& filename);
+
+    // Resolves the name written in an #include directive of 'includer' to the filename passed to load().
+    // Returns false to let the preprocessor search the filesystem, which is what the default implementation does.
+    virtual bool locate(const std::string& name, const std::string& includer, std::string& resolved)
+    {
+        (void)name; (void)includer; (void)resolved;
+        return false;
+    }
+};
+
+struct IncludedFile
+{
+    std::string filename;
+    std::shared_ptr<const std::string> contents;
+};
+
+class TokenCache;
+
+struct PreprocessOptions
+{
+    // "NAME" or "NAME=VALUE", as with -D
+    std::vector<std::string> defines;
+    IncludeLoader* loader { nullptr };
+    // If set, receives every file opened through #include, in inclusion order
+    std::vector<IncludedFile>* included_files { nullptr };
+    // If set, the included files are lexed once and replayed from there afterwards
+    TokenCache* token_cache { nullptr };
+    // If set, the input is preprocessed as if it started by including the header, see precompiled_header.hpp.
+    // 'defines' must be the ones it was built with.
+    const PrecompiledHeader* prelude { nullptr };
+    // The offsets of the ';' comments of the input, as find_comments() gives them, which are dropped from it. Only
+    // an input that has to go through Wave is copied without them, the others are preprocessed in place.
+    gsl::span<const size_t> comments;
+};
+
+// A line of preprocessed output, without its newline
+struct PreprocessedLine
+{
+    std::string_view text;
+    // where the line comes from, as the #line directives of the text output tell it
+    std::string_view filename;
+    unsigned line { 0 };
+};
+
+// Finds the ';' comments, which run up to the end of their line, and stores the offsets of their ';'. A ';' in a
+// string literal or in a '//' or '/* */' comment doesn't start one.
+void find_comments(std::string_view input, std::vector<size_t>& comments);
+// Returns 'input' as-is when there is no comment, otherwise it is stored without them in 'storage' and a view to it
+// is returned.
+std::string_view remove_comments(std::string_view input, gsl::span<const size_t> comments, std::string& storage);
+// Both at once, for the inputs that are preprocessed without PreprocessOptions::comments
+std::string_view pre_preprocess(std::string_view input, std::string& storage);
+std::string preprocess(std::string_view input, std::string_view filename, const PreprocessOptions& options = {});
+// Same, into 'processed' so that its capacity can be reused
+void preprocess(std::string_view input, std::string_view filename, const PreprocessOptions& options,
+                std::string& processed);
+// Same, handing the output to 'consumer' as it is produced, in chunks of at least 'chunk_size' bytes that end with
+// a complete line. Only the last chunk can be shorter or end in the middle of a line.
+void preprocess(std::string_view input, std::string_view filename, const PreprocessOptions& options,
+                size_t chunk_size, const std::function<void(std::string&&)>& consumer);
+// Same, handing the output to 'consumer' line by line as it is produced, in batches of at least 'batch_size' bytes,
+// so that the whole output is never held. The positions come from Wave instead of #line directives, which are left
+// out along with the empty lines. The views are only valid during the call, and 'consumer' must not throw.
+void preprocess(std::string_view input, std::string_view filename, const PreprocessOptions& options,
+                size_t batch_size, const std::function<void(gsl::span<const PreprocessedLine>)>& consumer);
+
+// Runs the header 'input' as an included file would be, and returns the state it leaves the preprocessor in.
+// Throws if the header outputs anything else than blank lines.
+PrecompiledHeader precompile_header(std::string_view input, std::string_view filename,
+                                    const PreprocessOptions& options = {});
 }
 
 #endif // PREPROCESSOR_HPP
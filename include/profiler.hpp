@@ -0,0 +1,173 @@
+/*
+profiler.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <cstdint>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+#include "perf_counters.hpp"
+
+namespace floaty
+{
+
+enum class Phase
+{
+    Read,
+    PrePreprocess,
+    Preprocess,
+    Parse,
+    BuildSymbolTable,
+    Encode,
+    Write,
+    Count
+};
+
+const char* phase_name(Phase phase);
+// What the item count of 'phase' counts
+const char* phase_unit(Phase phase);
+
+// Nanoseconds of CPU time used by the calling thread
+uint64_t thread_cpu_time();
+
+// Wall time, CPU time, item counts and heap allocations accumulated per phase by every thread.
+// Nested phases are exclusive : the time spent reading an include is counted as Read, not as Preprocess.
+// The peak is the exception, it is the most heap a single run of the phase and its nested phases added on top
+// of what was live when it started. Allocations are only counted in FLOATY_ALLOC_STATS builds, hardware events
+// only once enable_hardware_counters() succeeded.
+class Profiler
+{
+public:
+    struct PhaseStats
+    {
+        uint64_t wall_ns { 0 };
+        uint64_t cpu_ns { 0 };
+        uint64_t calls { 0 };
+        uint64_t items { 0 };
+        uint64_t allocations { 0 };
+        uint64_t alloc_bytes { 0 };
+        uint64_t peak_bytes { 0 };
+        HardwareCounts events { };
+    };
+
+    Profiler();
+
+    // Counts hardware events per phase from now on, returns false with the reason if the counters are unavailable
+    bool enable_hardware_counters(std::string& reason);
+    bool hardware_counters() const
+    {
+        return count_events;
+    }
+
+    // Adds one run of 'phase', its 'calls' are ignored
+    void record(Phase phase, const PhaseStats& run);
+
+    PhaseStats stats(Phase phase) const;
+    // Wall time since the profiler was created
+    uint64_t elapsed_ns() const;
+
+    void print_text(std::ostream& stream) const;
+    void print_json(std::ostream& stream) const;
+
+    // The profiler ScopedPhase reports to, none by default
+    static Profiler* active()
+    {
+        return active_profiler.load(std::memory_order_relaxed);
+    }
+    static void set_active(Profiler* profiler)
+    {
+        active_profiler.store(profiler, std::memory_order_relaxed);
+    }
+
+private:
+    struct Counters
+    {
+        std::atomic<uint64_t> wall_ns { 0 };
+        std::atomic<uint64_t> cpu_ns { 0 };
+        std::atomic<uint64_t> calls { 0 };
+        std::atomic<uint64_t> items { 0 };
+        std::atomic<uint64_t> allocations { 0 };
+        std::atomic<uint64_t> alloc_bytes { 0 };
+        std::atomic<uint64_t> peak_bytes { 0 };
+        std::array<std::atomic<uint64_t>, (size_t)HardwareEvent::Count> events { };
+    };
+
+    void print_hardware_text(std::ostream& stream) const;
+
+    std::array<Counters, (size_t)Phase::Count> counters;
+    std::chrono::steady_clock::time_point start;
+    bool count_events { false };
+
+    static std::atomic<Profiler*> active_profiler;
+};
+
+class TraceWriter;
+
+// Accounts the lifetime of the object to 'phase' and traces it as a span, does nothing unless a profiler or a
+// trace writer is active
+class ScopedPhase
+{
+public:
+    explicit ScopedPhase(Phase phase);
+    ~ScopedPhase();
+
+    ScopedPhase(const ScopedPhase&) = delete;
+    ScopedPhase& operator=(const ScopedPhase&) = delete;
+
+    void add_items(uint64_t count)
+    {
+        run.items += count;
+    }
+
+    // Stops accounting to the phase, e.g. while the thread waits for another one, until resume()
+    void pause();
+    void resume();
+
+private:
+
+    Profiler* profiler;
+    TraceWriter* tracer;
+    Phase phase;
+    uint64_t trace_start { 0 };
+    ScopedPhase* parent { nullptr };
+    Profiler::PhaseStats run;
+    std::chrono::steady_clock::time_point wall_start;
+    uint64_t cpu_start { 0 };
+    uint64_t allocations_start { 0 };
+    uint64_t alloc_bytes_start { 0 };
+    int64_t live_start { 0 };
+    // the thread's peak before this phase reset it
+    int64_t outer_peak { 0 };
+    HardwareCounts events_start { };
+};
+
+}
+
+#endif // PROFILER_HPP
@@ -43,7 +43,8 @@ bool is_dup(const Instruction& ins);
 bool is_pseudo_ins(const Instruction& ins);
 
 size_t handle_seek_directive(const Instruction& ins, size_t old_idx);
-std::vector<uint8_t> handle_data_insert_directive(const Instruction& ins);
+// Replaces the contents of 'data' with the bytes the directive inserts
+void handle_data_insert_directive(const Instruction& ins, std::vector<uint8_t>& data);
 void handle_dup_directive(const Instruction& ins, std::function<void(const Instruction&)> callback);
 
 }
@@ -0,0 +1,84 @@
+/*
+remote_cache.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef REMOTE_CACHE_HPP
+#define REMOTE_CACHE_HPP
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "cache_backend.hpp"
+#include "socket_stream.hpp"
+
+namespace floaty
+{
+
+/*
+Client for a shared cache server speaking HTTP/1.1 over TCP or a Unix domain socket :
+
+    GET /cache/<key>            200 with the image as body, or 404
+    PUT /cache/<key>            the image as body, answered with 201
+
+Every request goes through one persistent connection and is pipelined : requests are written as soon as
+they are issued and a reader thread matches the answers, which come back in order, to the pending futures.
+If the server can't be reached or the connection drops, every lookup resolves as a miss.
+With a timeout, connecting or writing a request that stalls for longer gives up, and the cache is then disabled for
+the run.
+*/
+class RemoteCache : public CacheBackend
+{
+public:
+    explicit RemoteCache(const Endpoint& endpoint, std::chrono::milliseconds timeout = {});
+    ~RemoteCache() override;
+
+    std::future<CachedImage> get(const std::string& key) override;
+    void put(const std::string& key, gsl::span<const uint8_t> data) override;
+
+    bool connected() const
+    {
+        return stream != nullptr;
+    }
+
+private:
+    void send(const std::string& request, std::promise<CachedImage> promise);
+    void read_responses();
+    void fail_pending();
+
+    std::unique_ptr<SocketStream> stream;
+    std::thread reader;
+
+    std::mutex write_mutex;
+    std::mutex mutex;
+    std::condition_variable drained;
+    std::deque<std::promise<CachedImage>> pending;
+    bool broken { false };
+};
+
+}
+
+#endif // REMOTE_CACHE_HPP
@@ -0,0 +1,53 @@
+/*
+server.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef SERVER_HPP
+#define SERVER_HPP
+
+#include <string>
+
+namespace floaty
+{
+
+/*
+Assembler daemon listening on a Unix domain socket.
+A connection can send any number of requests, one after the other :
+
+    ASSEMBLE
+    file <path>                 source file to assemble
+    text <size> [<name>]        or inline source : exactly <size> bytes follow this line
+    define <NAME[=VALUE]>       optional, repeatable
+    output <path>               optional, write the image there instead of sending it back
+    <empty line>
+
+Each request gets one of these answers :
+
+    OK <size>                   followed by the <size> bytes of the image, 0 if an output path was given
+    ERROR <status> <size>       followed by <size> bytes of diagnostics, <status> is the command line exit code
+*/
+int serve(const std::string& socket_path);
+
+}
+
+#endif // SERVER_HPP
@@ -0,0 +1,83 @@
+/*
+socket_stream.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef SOCKET_STREAM_HPP
+#define SOCKET_STREAM_HPP
+
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <optional>
+
+namespace floaty
+{
+
+// "unix:<path>" or "http://<host>:<port>" ("tcp://" is accepted too)
+struct Endpoint
+{
+    bool is_unix { true };
+    std::string path;
+    std::string host;
+    std::string port;
+};
+
+Endpoint parse_endpoint(std::string_view str);
+
+// Both return a socket file descriptor, or -1 with errno set
+// With a positive 'timeout', connecting to each address gives up after it, and so does a later send() on the socket
+// that can't make any progress for that long. The host name lookup isn't bounded.
+int connect_to(const Endpoint& endpoint, std::chrono::milliseconds timeout = {});
+int listen_on(const Endpoint& endpoint, int backlog = 64);
+
+// Minimal buffered reader/writer over a connected socket, owns the file descriptor
+class SocketStream
+{
+public:
+    explicit SocketStream(int fd)
+        : fd(fd)
+    {}
+    ~SocketStream();
+
+    SocketStream(const SocketStream&) = delete;
+    SocketStream& operator=(const SocketStream&) = delete;
+
+    // Both return an empty optional once the peer closed the connection
+    std::optional<std::string> read_line();
+    std::optional<std::string> read_bytes(size_t size);
+
+    bool write_all(std::string_view data);
+
+    // Wakes up a reader blocked on this stream
+    void shutdown();
+
+private:
+    bool fill();
+
+    int fd;
+    std::string buffer;
+};
+
+}
+
+#endif // SOCKET_STREAM_HPP
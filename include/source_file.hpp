@@ -0,0 +1,75 @@
+/*
+source_file.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef SOURCE_FILE_HPP
+#define SOURCE_FILE_HPP
+
+#include <string>
+#include <string_view>
+#include <stdexcept>
+
+namespace floaty
+{
+
+struct io_error : std::runtime_error
+{
+        using std::runtime_error::runtime_error;
+};
+
+[[noreturn]] inline void io_error_throw(const std::string& why, const std::string& filename)
+{
+    throw io_error(why + ": " + filename);
+}
+
+// Read-only view over the contents of an input file.
+// Regular files are memory-mapped, anything else (pipes, character devices...) is read into a buffer.
+class SourceFile
+{
+public:
+    explicit SourceFile(const std::string& filename);
+    ~SourceFile();
+
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    std::string_view view() const
+    {
+        return {contents, size};
+    }
+
+    bool is_mapped() const
+    {
+        return mapping != nullptr;
+    }
+
+private:
+    void* mapping { nullptr };
+    const char* contents { nullptr };
+    size_t size { 0 };
+    std::string buffer;
+};
+
+}
+
+#endif // SOURCE_FILE_HPP
@@ -32,12 +32,16 @@ SOFTWARE.
 #include <string_view>
 #include <string>
 
+#include "dispatch_stats.hpp"
+
 namespace floaty
 {
 
-inline std::vector<std::string_view> split(std::string_view str, std::string_view chars = " ", bool ignore_quotes = false, bool skip_empty = true)
+// Same as split() below, into 'result' so that its capacity can be reused
+inline void split(std::string_view str, std::vector<std::string_view>& result, std::string_view chars = " ",
+                  bool ignore_quotes = false, bool skip_empty = true)
 {
-    std::vector<std::string_view> result;
+    result.clear();
 
     size_t idx { 0 };
     bool in_quote { false };
@@ -57,7 +61,12 @@ inline std::vector<std::string_view> split(std::string_view str, std::string_vie
             result.push_back(std::string_view(&str[begin], idx - begin));
         }
     } while (++idx < str.size());
+}
 
+inline std::vector<std::string_view> split(std::string_view str, std::string_view chars = " ", bool ignore_quotes = false, bool skip_empty = true)
+{
+    std::vector<std::string_view> result;
+    split(str, result, chars, ignore_quotes, skip_empty);
     return result;
 }
 
@@ -82,6 +91,7 @@ inline bool is_number(const std::string& str)
     if (str.empty()) return false;
 
     char* p;
+    count_numeric_conversions();
     std::strtol(str.c_str(), &p, 0);
 
     return *p == '\0';
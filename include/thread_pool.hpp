@@ -0,0 +1,94 @@
+/*
+thread_pool.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <cstddef>
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace floaty
+{
+
+// Fixed-size pool where every worker owns a task deque.
+// A worker runs its own tasks from the front and, once empty, steals from the back of the others.
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(size_t thread_count = default_thread_count());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Tasks are dealt round-robin, submit the most expensive ones first for a better balance
+    void submit(Task task);
+    // Blocks until every submitted task has run
+    void wait();
+
+    size_t size() const
+    {
+        return workers.size();
+    }
+
+    // Index of the pool worker running the calling thread, or -1 outside the pool
+    static int current_worker();
+
+    static size_t default_thread_count();
+
+private:
+    struct Worker
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    void run(size_t index);
+    bool pop_task(size_t index, Task& task);
+    bool steal_task(size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    size_t next_worker { 0 };
+
+    std::mutex state_mutex;
+    std::condition_variable work_available;
+    std::condition_variable work_done;
+    size_t queued { 0 };
+    size_t unfinished { 0 };
+    bool stopping { false };
+};
+
+}
+
+#endif // THREAD_POOL_HPP
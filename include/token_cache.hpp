@@ -0,0 +1,108 @@
+/*
+token_cache.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef TOKEN_CACHE_HPP
+#define TOKEN_CACHE_HPP
+
+#include <cstdint>
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <gsl/gsl_span.hpp>
+
+#include "source_file.hpp"
+
+namespace floaty
+{
+
+// A token as Boost.Wave's lexer produced it, its value is in the value pool of the entry
+struct CachedToken
+{
+    uint32_t id;
+    uint32_t line;
+    uint32_t column;
+    uint32_t value_offset;
+    uint32_t value_size;
+};
+
+// A cache entry, mapped read-only : a header, the tokens, then their values
+class TokenStream
+{
+public:
+    // Throws io_error if the entry can't be read or is malformed
+    explicit TokenStream(const std::string& path);
+
+    gsl::span<const CachedToken> tokens() const
+    {
+        return token_span;
+    }
+
+    std::string_view value(const CachedToken& token) const
+    {
+        return values.substr(token.value_offset, token.value_size);
+    }
+
+private:
+    SourceFile file;
+    gsl::span<const CachedToken> token_span;
+    std::string_view values;
+};
+
+/*
+On-disk cache of the tokens lexed out of included files, so that a file included again, by another job or another
+run, is replayed instead of being lexed. Layout of the cache directory :
+    tokens/xx/yyyy...   one entry per lexed file, named after its key
+    tmp/                entries being written, renamed into tokens/ once complete
+The key is made of the contents of the file and of the lexer options. Neither its path nor the macros matter : the
+tokens are stored without their file name and Wave lexes before it expands anything.
+Entries are never evicted, the directory can be emptied at any time. Any number of processes can share it.
+*/
+class TokenCache
+{
+public:
+    explicit TokenCache(std::string directory);
+
+    static std::string key(std::string_view contents, uint32_t language);
+
+    // Returns nullptr if the tokens aren't cached
+    std::shared_ptr<const TokenStream> lookup(const std::string& key) const;
+    // Errors are ignored, the file is only lexed again next time
+    void store(const std::string& key, gsl::span<const CachedToken> tokens, std::string_view values);
+
+    const std::string& path() const
+    {
+        return directory;
+    }
+
+private:
+    std::string entry_path(const std::string& key) const;
+
+    std::string directory;
+};
+
+}
+
+#endif // TOKEN_CACHE_HPP
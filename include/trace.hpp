@@ -0,0 +1,152 @@
+/*
+trace.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace floaty
+{
+
+/*
+Collects trace events and writes them in the Chrome trace-event JSON format, which chrome://tracing and
+Perfetto load. Every thread records into its own buffer and gets its own track, named after its pool worker or
+what set_thread_name() gave.
+Events only cost anything while a writer is active : ScopedPhase and TraceSpan check TraceWriter::active() and
+do nothing when it is null.
+*/
+class TraceWriter
+{
+public:
+    TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    // Nanoseconds since the writer was created
+    uint64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // A span from 'start_ns' to now on the calling thread's track, 'name' must outlive the writer
+    void complete(const char* category, const char* name, uint64_t start_ns, int64_t items = -1);
+    void complete(const char* category, std::string name, uint64_t start_ns, int64_t items = -1);
+
+    // Adds 'delta' to the process-wide counter 'name', which must outlive the writer
+    void count(const char* name, int64_t delta);
+
+    void write(const std::string& filename) const;
+
+    static TraceWriter* active()
+    {
+        return active_writer.load(std::memory_order_relaxed);
+    }
+    static void set_active(TraceWriter* writer)
+    {
+        active_writer.store(writer, std::memory_order_relaxed);
+    }
+
+    // Names the track of the calling thread in this writer and the ones created later, for the threads that aren't
+    // pool workers, which are otherwise all "main"
+    static void set_thread_name(std::string_view name);
+
+private:
+    struct Event
+    {
+        char type;
+        const char* category;
+        const char* static_name;
+        std::string name;
+        uint64_t start_ns;
+        uint64_t duration_ns;
+        int64_t value;
+    };
+
+    struct ThreadBuffer
+    {
+        unsigned tid;
+        std::string thread_name;
+        std::vector<Event> events;
+    };
+
+    struct Counter
+    {
+        const char* name;
+        int64_t value;
+    };
+
+    ThreadBuffer& thread_buffer();
+
+    std::chrono::steady_clock::time_point start;
+
+    mutable std::mutex mutex;
+    std::deque<std::unique_ptr<ThreadBuffer>> buffers;
+    std::vector<Counter> counters;
+    unsigned generation;
+
+    static std::atomic<TraceWriter*> active_writer;
+};
+
+// A span on the calling thread's track, covering the lifetime of the object
+class TraceSpan
+{
+public:
+    TraceSpan(const char* category, std::string_view name)
+        : writer(TraceWriter::active())
+    {
+        if (!writer) return;
+        this->category = category;
+        this->name = name;
+        start_ns = writer->now();
+    }
+
+    ~TraceSpan()
+    {
+        if (writer) writer->complete(category, std::move(name), start_ns);
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    TraceWriter* writer;
+    const char* category { nullptr };
+    std::string name;
+    uint64_t start_ns { 0 };
+};
+
+}
+
+#endif // TRACE_HPP
@@ -0,0 +1,112 @@
+/*
+alloc_stats.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "alloc_stats.hpp"
+
+#include <malloc.h>
+
+#include <cstdlib>
+#include <new>
+
+namespace floaty
+{
+
+namespace
+{
+
+// constant initialized, so it's usable from operator new before any constructor ran
+thread_local ThreadAllocs allocs;
+
+}
+
+ThreadAllocs &thread_allocs()
+{
+    return allocs;
+}
+
+}
+
+#ifdef FLOATY_ALLOC_STATS
+
+namespace
+{
+
+void* counted_alloc(size_t size, size_t alignment = 0)
+{
+    if (size == 0) size = 1;
+    void* ptr = alignment ? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+                          : std::malloc(size);
+    if (!ptr) return nullptr;
+
+    auto& allocs = floaty::thread_allocs();
+    const auto usable = ::malloc_usable_size(ptr);
+    ++allocs.count;
+    allocs.bytes += usable;
+    allocs.live += usable;
+    if (allocs.live > allocs.peak) allocs.peak = allocs.live;
+    return ptr;
+}
+
+void counted_free(void* ptr)
+{
+    if (!ptr) return;
+
+    floaty::thread_allocs().live -= ::malloc_usable_size(ptr);
+    std::free(ptr);
+}
+
+void* checked_alloc(size_t size, size_t alignment = 0)
+{
+    while (true)
+    {
+        if (void* ptr = counted_alloc(size, alignment)) return ptr;
+
+        auto handler = std::get_new_handler();
+        if (!handler) throw std::bad_alloc();
+        handler();
+    }
+}
+
+}
+
+void* operator new(size_t size) { return checked_alloc(size); }
+void* operator new[](size_t size) { return checked_alloc(size); }
+void* operator new(size_t size, std::align_val_t align) { return checked_alloc(size, size_t(align)); }
+void* operator new[](size_t size, std::align_val_t align) { return checked_alloc(size, size_t(align)); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+
+void operator delete(void* ptr) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { counted_free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { counted_free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { counted_free(ptr); }
+
+#endif
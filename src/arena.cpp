@@ -0,0 +1,63 @@
+/*
+arena.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "arena.hpp"
+
+#include <cstdint>
+
+#include <algorithm>
+
+namespace floaty
+{
+
+size_t Arena::capacity() const
+{
+    size_t total { 0 };
+    for (const auto& block : blocks) total += block.size;
+    return total;
+}
+
+void *Arena::do_allocate(size_t bytes, size_t alignment)
+{
+    for (; current < blocks.size(); ++current, offset = 0)
+    {
+        auto base = reinterpret_cast<uintptr_t>(blocks[current].data.get());
+        size_t start = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+        if (start + bytes <= blocks[current].size)
+        {
+            offset = start + bytes;
+            return blocks[current].data.get() + start;
+        }
+    }
+
+    // none of the blocks has room left, blocks are only added at the end so that reset() keeps their order
+    const size_t size = std::max(block_size, bytes + alignment);
+    blocks.push_back({std::make_unique<std::byte[]>(size), size});
+    current = blocks.size() - 1;
+    offset = 0;
+    return do_allocate(bytes, alignment);
+}
+
+}
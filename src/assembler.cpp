@@ -25,11 +25,20 @@ SOFTWARE.
 
 #include "assembler.hpp"
 
+#include <array>
+#include <memory_resource>
+#include <string_view>
 #include <unordered_map>
 #include <iostream>
 
+#include "opcode_table.hpp"
+#include "dispatch_stats.hpp"
+#ifdef FLOATY_OPCODE_TEMPLATES
 #include "opcode_def.hpp"
+#endif
 #include "pseudo_instructions.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
 
 namespace floaty
 {
@@ -39,6 +48,7 @@ constexpr const char test_fmt[] = "LD Bx, n, B(Nx), [Iy+n], [Iy+Bx+n], [addr]";
 constexpr const char test_pat2[] = "11_xnn";
 constexpr const char test_fmt2[] = "LD [addr], Bx";
 
+#ifdef FLOATY_OPCODE_TEMPLATES
 static_assert(std::get<0>(Opcode<test_pat, test_fmt>::operands()).type() == OperandType::BReg);
 static_assert(std::get<1>(Opcode<test_pat, test_fmt>::operands()).type() == OperandType::ByteImmediate);
 static_assert(std::get<2>(Opcode<test_pat, test_fmt>::operands()).type() == OperandType::BIndirectReg);
@@ -47,206 +57,258 @@ static_assert(std::get<4>(Opcode<test_pat, test_fmt>::operands()).type() == Oper
 static_assert(std::get<5>(Opcode<test_pat, test_fmt>::operands()).type() == OperandType::IndirectAddr);
 
 static_assert(std::get<0>(Opcode<test_pat2, test_fmt2>::operands()).type() == OperandType::IndirectAddr);
+#else
+static_assert(make_opcode_desc(test_pat, test_fmt).operands[0].type == OperandType::BReg);
+static_assert(make_opcode_desc(test_pat, test_fmt).operands[1].type == OperandType::ByteImmediate);
+static_assert(make_opcode_desc(test_pat, test_fmt).operands[2].type == OperandType::BIndirectReg);
+static_assert(make_opcode_desc(test_pat, test_fmt).operands[3].type == OperandType::IndirectIRegPlusN);
+static_assert(make_opcode_desc(test_pat, test_fmt).operands[4].type == OperandType::IndirectIRegPlusBRegPlusN);
+static_assert(make_opcode_desc(test_pat, test_fmt).operands[5].type == OperandType::IndirectAddr);
 
-using SymbolTable = std::unordered_map<std::string, uint16_t>;
+static_assert(make_opcode_desc(test_pat2, test_fmt2).operands[0].type == OperandType::IndirectAddr);
+#endif
 
-template <typename Opcode>
-bool matches(const Instruction& ins)
+#define TOKENPASTE2(x, y) x ## y
+#define TOKENPASTE(x, y) TOKENPASTE2(x, y)
+
+#ifdef FLOATY_OPCODE_TEMPLATES
+#define OPCODE_DEF(pattern, fmt) \
+    static constexpr const char TOKENPASTE(opcode_pattern_, pattern)[] = #pattern; \
+    static constexpr const char TOKENPASTE(opcode_fmt_, pattern)[] = fmt;
+#include "opcodes.def"
+#endif
+
+// Every entry of opcodes.def, in order. Evaluating make_opcode_desc() validates them at compile time.
+// FLOATY_OPCODE_TEMPLATES builds the same table by instantiating Opcode<> for each entry instead, which compiles
+// much slower, see tools/compile_bench.cpp.
+constexpr OpcodeDesc opcode_table[] =
+{
+#ifdef FLOATY_OPCODE_TEMPLATES
+    #define OPCODE_DEF(pattern, fmt) \
+        describe_opcode<Opcode<TOKENPASTE(opcode_pattern_, pattern), TOKENPASTE(opcode_fmt_, pattern)>>(),
+#else
+    #define OPCODE_DEF(pattern, fmt) make_opcode_desc(#pattern, fmt),
+#endif
+    #include "opcodes.def"
+};
+
+// Keys are views of the label names of the instructions being assembled
+using SymbolTable = std::pmr::unordered_map<std::string_view, uint16_t>;
+
+using OperandArgs = std::array<const std::string*, max_operand_count>;
+
+// Points 'args' to the argument of 'ins' that goes to each operand of 'opcode'. Returns false if 'ins' has too few
+// arguments.
+bool get_operand_args(const OpcodeDesc& opcode, const Instruction& ins, OperandArgs& args)
 {
-    if (Opcode::mnemonic() != ins.mnemo) return false;
+    const auto& arguments = ins.arguments;
+    const size_t count = opcode.operand_count;
     // try to transform <op> rx, ry into <op> rx, rx, ry
-    if (Opcode::operand_count() != ins.arguments.size() && ins.arguments.size() == 2)
+    if (count != arguments.size() && arguments.size() == 2)
     {
-        Instruction new_ins = ins;
-        new_ins.arguments = {ins.arguments[0], ins.arguments[0], ins.arguments[1]};
-        return matches<Opcode>(new_ins);
+        const std::string* transformed[] = {&arguments[0], &arguments[0], &arguments[1]};
+        if (count > 3) return false;
+        std::copy_n(transformed, count, args.begin());
+        return true;
     }
 
-    bool is_valid = true;
-    for_each_in_tuple(Opcode::operands(), [&ins, &is_valid](auto operand, size_t idx)
+    if (arguments.size() < count) return false;
+    for (size_t i { 0 }; i < count; ++i)
     {
-        switch (operand.type())
-        {
-            case OperandType::ByteImmediate:
-                is_valid &= is_immediate(ins.arguments[idx]);
-                return;
-            case OperandType::Address:
-                is_valid &= is_address(ins.arguments[idx]);
-                return;
-            case OperandType::IndirectAddr:
-                is_valid &= is_indir_address(ins.arguments[idx]);
-                return;
-            case OperandType::NReg:
-                is_valid &= is_reg(ins.arguments[idx], 'N');
-                return;
-            case OperandType::BReg:
-                is_valid &= is_reg(ins.arguments[idx], 'B');
-                return;
-            case OperandType::IReg:
-                is_valid &= is_reg(ins.arguments[idx], 'I');
-                return;
-            case OperandType::BIndirectReg:
-                is_valid &= is_indir_reg(ins.arguments[idx], 'B');
-                return;
-            case OperandType::IIndirectReg:
-                is_valid &= is_indir_reg(ins.arguments[idx], 'I');
-                return;
-            case OperandType::StackPointer:
-                is_valid &= ins.arguments[idx] == "SP";
-                return;
-            case OperandType::IndirectIReg:
-                is_valid &= is_indir_ireg_plus_n(ins.arguments[idx]);
-                return;
-            case OperandType::IndirectIRegPlusN:
-                is_valid &= is_indir_address_plus_n(ins.arguments[idx]);
-                return;
-            case OperandType::IndirectIRegPlusBRegPlusN:
-                is_valid &= is_indir_address_plus_breg_plus_n(ins.arguments[idx]);
-                return;
-            case OperandType::SoundTimer:
-                is_valid &= ins.arguments[idx] == "ST";
-                return;
-            case OperandType::DelayTimer:
-                is_valid &= ins.arguments[idx] == "DT";
-                return;
-            case OperandType::Invalid:
-                __builtin_unreachable();
-        }
-    });
+        args[i] = &arguments[i];
+    }
+    return true;
+}
 
-    return is_valid;
+bool matches(const OperandDesc& operand, const std::string& arg)
+{
+    switch (operand.type)
+    {
+        case OperandType::ByteImmediate:
+            return is_immediate(arg);
+        case OperandType::Address:
+            return is_address(arg);
+        case OperandType::IndirectAddr:
+            return is_indir_address(arg);
+        case OperandType::NReg:
+            return is_reg(arg, 'N');
+        case OperandType::BReg:
+            return is_reg(arg, 'B');
+        case OperandType::IReg:
+            return is_reg(arg, 'I');
+        case OperandType::BIndirectReg:
+            return is_indir_reg(arg, 'B');
+        case OperandType::IIndirectReg:
+            return is_indir_reg(arg, 'I');
+        case OperandType::StackPointer:
+            return arg == "SP";
+        case OperandType::IndirectIReg:
+            return is_indir_ireg_plus_n(arg);
+        case OperandType::IndirectIRegPlusN:
+            return is_indir_address_plus_n(arg);
+        case OperandType::IndirectIRegPlusBRegPlusN:
+            return is_indir_address_plus_breg_plus_n(arg);
+        case OperandType::SoundTimer:
+            return arg == "ST";
+        case OperandType::DelayTimer:
+            return arg == "DT";
+        case OperandType::Invalid:
+            break;
+    }
+    __builtin_unreachable();
 }
 
-template <typename Opcode>
-uint32_t assemble_opcode(const Instruction& ins, const SymbolTable& tbl)
+bool matches(const OpcodeDesc& opcode, const Instruction& ins, DispatchCounters& counters)
 {
-    // try to transform <op> rx, ry into <op> rx, rx, ry
-    if (Opcode::operand_count() != ins.arguments.size() && ins.arguments.size() == 2)
+    if (opcode.mnemonic != ins.mnemo) return false;
+
+    OperandArgs args;
+    if (!get_operand_args(opcode, ins, args)) return false;
+    if constexpr (dispatch_stats_enabled)
+    {
+        ++counters.operand_checks;
+        if (opcode.operand_count != ins.arguments.size() && ins.arguments.size() == 2) ++counters.fallbacks;
+    }
+
+    for (size_t idx { 0 }; idx < opcode.operand_count; ++idx)
     {
-        Instruction new_ins = ins;
-        new_ins.arguments = {ins.arguments[0], ins.arguments[0], ins.arguments[1]};
-        return assemble_opcode<Opcode>(new_ins, tbl);
+        if (!matches(opcode.operands[idx], *args[idx])) return false;
     }
 
-    uint32_t opcode { Opcode::base() };
+    return true;
+}
+
+uint32_t assemble_opcode(const OpcodeDesc& opcode_desc, const Instruction& ins, const SymbolTable& tbl)
+{
+    OperandArgs args;
+    [[maybe_unused]] const bool matched = get_operand_args(opcode_desc, ins, args);
+    assert(matched);
+
+    uint32_t opcode { opcode_desc.base };
 
-    for_each_in_tuple(Opcode::operands(), [&ins, &opcode, &tbl](auto operand, size_t idx)
+    for (size_t idx { 0 }; idx < opcode_desc.operand_count; ++idx)
     {
-        switch (operand.type())
+        const auto& operand = opcode_desc.operands[idx];
+        const std::string& arg = *args[idx];
+
+        switch (operand.type)
         {
             case OperandType::ByteImmediate:
-                opcode |= std::stoi(ins.arguments[idx], nullptr, 0) << Opcode::template operand_offset<operand.operand_char()>()*4;
-                return;
+                count_numeric_conversions();
+                opcode |= std::stoi(arg, nullptr, 0) << operand.shift;
+                break;
             case OperandType::NReg:
             case OperandType::BReg:
             case OperandType::IReg:
-                opcode |= xdigit_to_num(ins.arguments[idx][1]) << Opcode::template operand_offset<operand.operand_char()>()*4;
-                return;
+                opcode |= xdigit_to_num(arg[1]) << operand.shift;
+                break;
             case OperandType::BIndirectReg:
             case OperandType::IIndirectReg:
-                opcode |= xdigit_to_num(ins.arguments[idx][3]) << Opcode::template operand_offset<operand.operand_char()>()*4;
-                return;
+                opcode |= xdigit_to_num(arg[3]) << operand.shift;
+                break;
             case OperandType::Address:
             case OperandType::IndirectAddr:
-                if (is_number(ins.arguments[idx]))
+                if (is_number(arg))
                 {
-                    opcode |= std::stoi(ins.arguments[idx], nullptr, 0);
+                    count_numeric_conversions();
+                    opcode |= std::stoi(arg, nullptr, 0);
                 }
                 else
                 {
-                    if (!tbl.count(ins.arguments[idx]))
+                    if (!tbl.count(arg))
                     {
-                        assembler_error_throw("label '" + ins.arguments[idx] + "' doesn't exist", ins.line, ins.filename);
+                        assembler_error_throw("label '" + arg + "' doesn't exist", ins.line, ins.filename);
                     }
-                    opcode |= tbl.at(ins.arguments[idx]);
+                    opcode |= tbl.at(arg);
                 }
-                return;
+                break;
             case OperandType::IndirectIRegPlusBRegPlusN:
-                opcode |= xdigit_to_num(ins.arguments[idx][5]) << Opcode::template operand_offset<operand.indexed_breg_char()>()*4;
+                opcode |= xdigit_to_num(arg[5]) << operand.breg_shift;
                 [[fallthrough]];
             case OperandType::IndirectIRegPlusN:
-                if (has_indirect_offset(ins.arguments[idx]))
+                if (has_indirect_offset(arg))
                 {
-                    if (is_number(std::string{get_indirect_offset(ins.arguments[idx])}))
+                    if (is_number(std::string{get_indirect_offset(arg)}))
                     {
-                        const int value = std::stoi(std::string{get_indirect_offset(ins.arguments[idx])}, nullptr, 0);
-                        if ((operand.type() == OperandType::IndirectIRegPlusN         && (value <= -128 || value >= 128)) ||
-                            (operand.type() == OperandType::IndirectIRegPlusBRegPlusN && (value < 0 || value >= 16)))
+                        count_numeric_conversions();
+                        const int value = std::stoi(std::string{get_indirect_offset(arg)}, nullptr, 0);
+                        if ((operand.type == OperandType::IndirectIRegPlusN         && (value <= -128 || value >= 128)) ||
+                            (operand.type == OperandType::IndirectIRegPlusBRegPlusN && (value < 0 || value >= 16)))
                             assembler_error_throw("indexed operand offset "
-                                                  + std::string{get_indirect_offset(ins.arguments[idx])}
+                                                  + std::string{get_indirect_offset(arg)}
                                                   + " is out of range", ins.line, ins.filename);
-                        opcode |= (int8_t)value << Opcode::template operand_offset<'n'>()*4;
+                        opcode |= (int8_t)value << opcode_desc.offset_shift;
                     }
                     else
                     {
                         assembler_error_throw("invalid indexed operand offset '"
-                                              + std::string{get_indirect_offset(ins.arguments[idx])} + "'", ins.line, ins.filename);
+                                              + std::string{get_indirect_offset(arg)} + "'", ins.line, ins.filename);
                     }
                 }
                 [[fallthrough]];
             case OperandType::IndirectIReg:
-                opcode |= xdigit_to_num(ins.arguments[idx][2]) << Opcode::template operand_offset<operand.operand_char()>()*4;
-                return;
+                opcode |= xdigit_to_num(arg[2]) << operand.shift;
+                break;
             case OperandType::Invalid:
                 __builtin_unreachable();
             default:
-                return;
+                break;
         }
-    });
+    }
 
     return opcode;
 }
 
-#define TOKENPASTE2(x, y) x ## y
-#define TOKENPASTE(x, y) TOKENPASTE2(x, y)
-
-// Explicitly instantiate functions for the opcode list so we can implement the function in the source file
-#define OPCODE_DEF(pattern, fmt) \
-    static constexpr const char TOKENPASTE(opcode_pattern_, pattern)[] = #pattern; \
-    static constexpr const char TOKENPASTE(opcode_fmt_, pattern)[] = fmt;
-#include "opcodes.def"
-
-std::pair<bool(*)(const Instruction&), uint32_t(*)(const Instruction&, const SymbolTable&)> call_table[] =
+// Follows the output index through the first pass and records the segments the program writes
+struct LayoutBuilder
 {
-    // Explicitly instantiate functions for the opcode list so we can implement the function in the source file
-    #define OPCODE_DEF(pattern, fmt) \
-{&matches<Opcode<TOKENPASTE(opcode_pattern_, pattern), TOKENPASTE(opcode_fmt_, pattern)>>,   \
-        &assemble_opcode<Opcode<TOKENPASTE(opcode_pattern_, pattern), TOKENPASTE(opcode_fmt_, pattern)>> \
-},
+    void advance(size_t count)
+    {
+        if (count == 0) return;
 
-    #include "opcodes.def"
+        if (layout.segments.empty() || layout.segments.back().address + layout.segments.back().size != index)
+        {
+            layout.segments.push_back({index, 0});
+        }
+        layout.segments.back().size += count;
+        index += count;
+    }
+
+    size_t index { 0 };
+    ImageLayout layout;
+    // bytes of the data directives, reused from one to the next
+    std::vector<uint8_t> data;
 };
 
-void apply_ins_offset(const Instruction& ins, size_t& index)
+void apply_ins_offset(const Instruction& ins, LayoutBuilder& builder)
 {
     // Check if it is a pseudo instruction
     if (is_seek(ins))
     {
-        index = handle_seek_directive(ins, index);
+        builder.index = handle_seek_directive(ins, builder.index);
     }
     else if (is_data_insert(ins))
     {
-        index += handle_data_insert_directive(ins).size();
+        handle_data_insert_directive(ins, builder.data);
+        builder.advance(builder.data.size());
     }
     else if (is_dup(ins))
     {
-        handle_dup_directive(ins, [&index](const Instruction& ins)
+        handle_dup_directive(ins, [&builder](const Instruction& ins)
         {
-            apply_ins_offset(ins, index);
+            apply_ins_offset(ins, builder);
         });
     }
     else
     {
         // regular instruction
-        index += 3;
+        builder.advance(3);
     }
 }
 
-SymbolTable build_symbol_table(gsl::span<const AssemblerDirective> instructions, size_t& index)
+void build_symbol_table(gsl::span<const AssemblerDirective> instructions, LayoutBuilder& builder, SymbolTable& tbl)
 {
-    SymbolTable tbl;
-
-    for (auto dir : instructions)
+    for (const auto& dir : instructions)
     {
         if (std::holds_alternative<Instruction>(dir))
         {
@@ -258,14 +320,12 @@ SymbolTable build_symbol_table(gsl::span<const AssemblerDirective> instructions,
                     assembler_error_throw("multiple definition of label " + ins.label->name, ins.line, ins.filename);
                 }
 
-                tbl[ins.label->name] = index;
+                tbl[ins.label->name] = builder.index;
             }
 
-            apply_ins_offset(ins, index);
+            apply_ins_offset(ins, builder);
         }
     }
-
-    return tbl;
 }
 
 class AssemblerOutput
@@ -278,19 +338,20 @@ public:
     };
 
 public:
-    AssemblerOutput(size_t max_size)
-        : data(max_size, 0)
+    AssemblerOutput(const ImageLayout& layout, std::vector<gsl::span<uint8_t>> buffers)
+        : layout(layout), buffers(std::move(buffers))
     {}
 
     template <typename T, size_t byte_size = sizeof(T), OutputEndianess endian = OutputEndianess::LittleEndian>
     void output_data(T value)
     {
         static_assert(byte_size <= sizeof(T));
+        uint8_t* out = reserve(byte_size);
         if constexpr (endian == OutputEndianess::LittleEndian)
         {
             for (size_t i { 0 }; i < byte_size; ++i)
             {
-                data[idx++] = value&0xFF;
+                out[i] = value&0xFF;
                 if constexpr (byte_size > 1) value >>= 8;
             }
         }
@@ -298,11 +359,11 @@ public:
         {
             for (size_t i { 0 }; i < byte_size; ++i)
             {
-                data[idx + (byte_size-i-1)] = value&0xFF;
+                out[byte_size-i-1] = value&0xFF;
                 if constexpr (byte_size > 1) value >>= 8;
             }
-            idx += byte_size;
         }
+        idx += byte_size;
     }
 
     void relocate(size_t new_idx)
@@ -311,8 +372,33 @@ public:
         idx = new_idx;
     }
 
-    std::vector<uint8_t> data;
     size_t idx { 0 };
+    size_t instruction_count { 0 };
+    // bytes of the data directives, reused from one to the next
+    std::vector<uint8_t> data;
+    // null unless statistics were asked for
+    ImageStats* stats { nullptr };
+    // uses of each opcode_table entry
+    std::vector<uint64_t> opcode_counts;
+
+private:
+    // Returns where the 'count' bytes at idx go, the first pass laid out the segments so that a write never
+    // straddles two of them
+    uint8_t* reserve(size_t count)
+    {
+        while (idx + count > layout.segments[segment].address + layout.segments[segment].size)
+        {
+            ++segment;
+            assert(segment < layout.segments.size());
+        }
+        assert(idx >= layout.segments[segment].address);
+
+        return buffers[segment].data() + (idx - layout.segments[segment].address);
+    }
+
+    const ImageLayout& layout;
+    std::vector<gsl::span<uint8_t>> buffers;
+    size_t segment { 0 };
 };
 
 void assemble_instruction(const Instruction& ins, const SymbolTable& sym_tbl, AssemblerOutput& out)
@@ -320,35 +406,72 @@ void assemble_instruction(const Instruction& ins, const SymbolTable& sym_tbl, As
     // handle pseudo instructions
     if (is_seek(ins))
     {
-        out.relocate(handle_seek_directive(ins, out.idx));
+        const size_t new_idx = handle_seek_directive(ins, out.idx);
+        if (out.stats)
+        {
+            ++out.stats->seeks;
+            out.stats->seek_skipped_bytes += new_idx - out.idx;
+        }
+        out.relocate(new_idx);
         return;
     }
     if (is_data_insert(ins))
     {
-        for (uint8_t byte : handle_data_insert_directive(ins))
+        handle_data_insert_directive(ins, out.data);
+        for (uint8_t byte : out.data)
         {
             out.output_data(byte);
         }
+        if (out.stats) out.stats->data_bytes[to_upper(ins.mnemo)] += out.data.size();
         return;
     }
     if (is_dup(ins))
     {
+        const size_t start = out.idx;
         handle_dup_directive(ins, [&sym_tbl, &out](const Instruction& ins)
         {
             assemble_instruction(ins, sym_tbl, out);
         });
+        if (out.stats)
+        {
+            // handle_dup_directive() validated the count
+            const uint64_t repetitions = std::max(std::stol(ins.arguments[0], nullptr, 0), 0l);
+            ++out.stats->dups;
+            out.stats->dup_repetitions += repetitions;
+            out.stats->dup_max_repetitions = std::max(out.stats->dup_max_repetitions, repetitions);
+            out.stats->dup_bytes += out.idx - start;
+        }
         return;
     }
 
-    for (auto call_pair : call_table)
+    DispatchCounters counters;
+    counters.instructions = 1;
+    const uint64_t conversions_start = dispatch_stats_enabled ? thread_numeric_conversions() : 0;
+    auto record = [&ins, &counters, conversions_start]
+    {
+        if constexpr (dispatch_stats_enabled)
+        {
+            counters.conversions = thread_numeric_conversions() - conversions_start;
+            record_dispatch(ins.mnemo, counters);
+        }
+    };
+
+    for (const auto& opcode : opcode_table)
     {
-        if (call_pair.first(ins))
+        if constexpr (dispatch_stats_enabled) ++counters.probes;
+        if (matches(opcode, ins, counters))
         {
-            out.output_data<uint32_t, 3, AssemblerOutput::BigEndian>(call_pair.second(ins, sym_tbl));
+            out.output_data<uint32_t, 3, AssemblerOutput::BigEndian>(assemble_opcode(opcode, ins, sym_tbl));
+            ++out.instruction_count;
+            if (out.stats) ++out.opcode_counts[&opcode - opcode_table];
+            record();
             return;
         }
     }
 
+    counters.unmatched = 1;
+    record();
+
     std::string ins_str = ins.mnemo + " ";
     for (size_t i { 0 }; i < ins.arguments.size(); ++i)
     {
@@ -359,27 +482,165 @@ void assemble_instruction(const Instruction& ins, const SymbolTable& sym_tbl, As
     assembler_error_throw("invalid instruction '" + ins_str + "'", ins.line, ins.filename);
 }
 
-std::vector<uint8_t> assemble(gsl::span<const AssemblerDirective> instructions)
+// Second pass, over the directives that went through build_symbol_table() in 'batches'
+void encode(gsl::span<const gsl::span<const AssemblerDirective>> batches, size_t directive_count,
+            LayoutBuilder& builder, const SymbolTable& sym_tbl, OutputSink& sink, ImageStats* stats)
 {
-    size_t max_index { 0 };
-    auto sym_tbl = build_symbol_table(instructions, max_index);
+    builder.layout.size = builder.index;
 
-    for (auto pair : sym_tbl)
+    ScopedPhase phase(Phase::Encode);
+    phase.add_items(directive_count);
+    AssemblerOutput asm_output(builder.layout, sink.allocate_segments(builder.layout));
+    asm_output.data = std::move(builder.data);
+    if (stats)
     {
+        *stats = ImageStats{};
+        asm_output.stats = stats;
+        asm_output.opcode_counts.assign(std::size(opcode_table), 0);
     }
 
-    AssemblerOutput asm_output(max_index);
+    for (const auto& instructions : batches)
+    {
+        for (const auto& dir : instructions)
+        {
+            if (std::holds_alternative<Instruction>(dir))
+            {
+                const auto& ins = std::get<Instruction>(dir);
+                assemble_instruction(ins, sym_tbl, asm_output);
+            }
+        }
+    }
 
-    for (auto dir : instructions)
+    if (stats)
     {
-        if (std::holds_alternative<Instruction>(dir))
+        for (size_t i { 0 }; i < asm_output.opcode_counts.size(); ++i)
         {
-            const auto& ins = std::get<Instruction>(dir);
-            assemble_instruction(ins, sym_tbl, asm_output);
+            if (asm_output.opcode_counts[i] == 0) continue;
+
+            const auto& opcode = opcode_table[i];
+            stats->opcodes.push_back({opcode.pattern, opcode.format, opcode.mnemonic, asm_output.opcode_counts[i]});
         }
+        stats->instructions = asm_output.instruction_count;
+        stats->code_bytes = asm_output.instruction_count * 3;
+        stats->labels = sym_tbl.size();
+        if (!builder.layout.segments.empty())
+        {
+            const auto& last = builder.layout.segments.back();
+            stats->highest_address = last.address + last.size - 1;
+        }
+        stats->image_size = builder.layout.size;
     }
 
-    return asm_output.data;
+    if (auto tracer = TraceWriter::active())
+    {
+        size_t bytes { 0 };
+        for (const auto& segment : builder.layout.segments) bytes += segment.size;
+
+        tracer->count("instructions_encoded", asm_output.instruction_count);
+        tracer->count("bytes_emitted", bytes);
+    }
+}
+
+void assemble(gsl::span<const AssemblerDirective> instructions, OutputSink& sink, std::pmr::memory_resource* scratch,
+              ImageStats* stats)
+{
+    LayoutBuilder builder;
+    SymbolTable sym_tbl(scratch);
+    {
+        ScopedPhase phase(Phase::BuildSymbolTable);
+        sym_tbl.reserve(instructions.size());
+        build_symbol_table(instructions, builder, sym_tbl);
+        phase.add_items(instructions.size());
+    }
+
+    const gsl::span<const AssemblerDirective> batches[] = { instructions };
+    encode(batches, instructions.size(), builder, sym_tbl, sink, stats);
+}
+
+struct IncrementalAssembler::State
+{
+    explicit State(std::pmr::memory_resource* scratch)
+        : sym_tbl(scratch)
+    {}
+
+    LayoutBuilder builder;
+    SymbolTable sym_tbl;
+    // the symbol table refers to the labels of these, they must stay where they are until finish()
+    std::vector<std::vector<AssemblerDirective>> batches;
+    size_t directive_count { 0 };
+};
+
+IncrementalAssembler::IncrementalAssembler(std::pmr::memory_resource* scratch)
+    : state(std::make_unique<State>(scratch))
+{}
+
+IncrementalAssembler::~IncrementalAssembler() = default;
+
+void IncrementalAssembler::add(std::vector<AssemblerDirective>&& batch)
+{
+    ScopedPhase phase(Phase::BuildSymbolTable);
+    state->directive_count += batch.size();
+    state->sym_tbl.reserve(state->directive_count);
+    build_symbol_table(batch, state->builder, state->sym_tbl);
+    phase.add_items(batch.size());
+
+    state->batches.emplace_back(std::move(batch));
+}
+
+void IncrementalAssembler::finish(OutputSink& sink, ImageStats* stats)
+{
+    std::vector<gsl::span<const AssemblerDirective>> batches(state->batches.begin(), state->batches.end());
+    encode(batches, state->directive_count, state->builder, state->sym_tbl, sink, stats);
+}
+
+std::vector<uint8_t> assemble(gsl::span<const AssemblerDirective> instructions)
+{
+    VectorSink sink;
+    assemble(instructions, sink);
+    return std::move(sink.data);
+}
+
+gsl::span<uint8_t> SegmentSink::allocate(size_t size)
+{
+    ImageLayout flat;
+    flat.size = size;
+    if (size > 0) flat.segments.push_back({0, size});
+
+    auto buffers = allocate_segments(flat);
+    return buffers.empty() ? gsl::span<uint8_t>{} : buffers.front();
+}
+
+std::vector<gsl::span<uint8_t>> SegmentSink::allocate_segments(const ImageLayout &layout)
+{
+    this->layout = layout;
+
+    size_t total { 0 };
+    offsets.clear();
+    for (const auto& segment : layout.segments)
+    {
+        offsets.emplace_back(total);
+        total += segment.size;
+    }
+    data.assign(total, 0);
+
+    std::vector<gsl::span<uint8_t>> buffers;
+    buffers.reserve(layout.segments.size());
+    for (size_t i { 0 }; i < layout.segments.size(); ++i)
+    {
+        buffers.emplace_back(gsl::span<uint8_t>(data).subspan(offsets[i], layout.segments[i].size));
+    }
+    return buffers;
+}
+
+std::vector<uint8_t> SegmentSink::flatten() const
+{
+    std::vector<uint8_t> image(layout.size, 0);
+    for (size_t i { 0 }; i < layout.segments.size(); ++i)
+    {
+        auto bytes = segment_data(i);
+        std::copy(bytes.begin(), bytes.end(), image.begin() + layout.segments[i].address);
+    }
+    return image;
 }
 
 }
@@ -0,0 +1,72 @@
+/*
+assembler_context.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "assembler_context.hpp"
+
+#include "profiler.hpp"
+
+namespace floaty
+{
+
+gsl::span<const uint8_t> AssemblerContext::assemble(std::string_view source, const std::string &filename,
+                                                    const PreprocessOptions &options)
+{
+    assemble(source, filename, options, image);
+    return image.data;
+}
+
+void AssemblerContext::assemble(std::string_view source, const std::string &filename, const PreprocessOptions &options,
+                                OutputSink &sink, ImageStats* stats)
+{
+    reset();
+
+    PreprocessOptions source_options = options;
+    {
+        ScopedPhase phase(Phase::PrePreprocess);
+        find_comments(source, comments);
+        source_options.comments = comments;
+        phase.add_items(source.size());
+    }
+    {
+        ScopedPhase phase(Phase::Preprocess);
+        preprocess(source, filename, source_options, preprocessed);
+        phase.add_items(preprocessed.size());
+    }
+    {
+        ScopedPhase phase(Phase::Parse);
+        directive_count = parse(preprocessed, filename, parse_scratch);
+        phase.add_items(directive_count);
+    }
+
+    floaty::assemble(directives(), sink, &symbols, stats);
+}
+
+void AssemblerContext::reset()
+{
+    directive_count = 0;
+    symbols.reset();
+}
+
+}
@@ -0,0 +1,337 @@
+/*
+build_cache.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "build_cache.hpp"
+
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include "hasher.hpp"
+#include "source_file.hpp"
+
+#ifndef FLOATY_BUILD_ID
+#define FLOATY_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+namespace fs = std::filesystem;
+
+namespace floaty
+{
+
+namespace
+{
+
+BuildCache::Stats read_stats(const std::string& path)
+{
+    BuildCache::Stats stats;
+
+    std::ifstream stream(path);
+    std::string name;
+    uint64_t value;
+    while (stream >> name >> value)
+    {
+        if (name == "hits") stats.hits = value;
+        else if (name == "misses") stats.misses = value;
+        else if (name == "size") stats.size = value;
+    }
+
+    return stats;
+}
+
+std::string format_stats(const BuildCache::Stats& stats)
+{
+    return "hits " + std::to_string(stats.hits) + "\n"
+         + "misses " + std::to_string(stats.misses) + "\n"
+         + "size " + std::to_string(stats.size) + "\n";
+}
+
+}
+
+void write_file_atomically(const std::string& path, const std::string& tmp_dir, gsl::span<const uint8_t> data)
+{
+    std::string tmp_path = tmp_dir + "/" + std::to_string(::getpid()) + "."
+            + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    {
+        std::ofstream stream(tmp_path, std::ios::trunc | std::ios::binary);
+        if (!stream.is_open())
+        {
+            io_error_throw("Could not write cache entry", tmp_path);
+        }
+        stream.write((const char*)data.data(), data.size());
+        if (!stream)
+        {
+            std::remove(tmp_path.c_str());
+            io_error_throw("Could not write cache entry", tmp_path);
+        }
+    }
+
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp_path.c_str());
+        io_error_throw("Could not publish cache entry", path);
+    }
+}
+
+const char *build_id()
+{
+    return "FloatyChipAsm-0.0.1-" FLOATY_BUILD_ID;
+}
+
+std::string compute_cache_key(std::string_view main_source, const std::string &filename,
+                              const std::vector<std::string> &defines,
+                              const std::vector<IncludedFile> &included_files,
+                              std::string_view variant, std::string_view prelude)
+{
+    Hasher hasher;
+    hasher.add(build_id());
+    hasher.add(filename);
+    hasher.add(main_source);
+
+    hasher.add(std::to_string(defines.size()));
+    for (const auto& define : defines)
+    {
+        hasher.add(define);
+    }
+
+    hasher.add(std::to_string(included_files.size()));
+    for (const auto& file : included_files)
+    {
+        hasher.add(file.filename);
+        hasher.add(*file.contents);
+    }
+
+    // keeps the keys of flat images unchanged
+    if (!variant.empty())
+    {
+        hasher.add(variant);
+    }
+    if (!prelude.empty())
+    {
+        hasher.add("prelude");
+        hasher.add(prelude);
+    }
+
+    return hasher.hex_digest();
+}
+
+BuildCache::BuildCache(std::string directory, uint64_t max_size)
+    : directory(std::move(directory)), max_size(max_size)
+{
+    std::error_code ec;
+    fs::create_directories(this->directory + "/objects", ec);
+    fs::create_directories(this->directory + "/tmp", ec);
+    if (ec)
+    {
+        io_error_throw("Could not create cache directory", this->directory);
+    }
+}
+
+CachedImage BuildCache::lookup(const std::string &key)
+{
+    const auto path = object_path(key);
+
+    CachedImage result;
+    try
+    {
+        SourceFile entry(path);
+        auto contents = entry.view();
+        result = std::vector<uint8_t>(contents.begin(), contents.end());
+
+        // refresh the entry for the LRU eviction
+        ::utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    }
+    catch (const io_error&)
+    {
+    }
+
+    try
+    {
+        update_stats([&result](Stats& stats)
+        {
+            ++(result ? stats.hits : stats.misses);
+        });
+    }
+    catch (const io_error&)
+    {
+        // the counters of a read-only or full cache directory are left as they are
+    }
+
+    return result;
+}
+
+void BuildCache::store(const std::string &key, gsl::span<const uint8_t> data)
+{
+    const auto path = object_path(key);
+
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0)
+    {
+        // already stored by a concurrent invocation
+        return;
+    }
+
+    std::error_code ec;
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    write_file_atomically(path, directory + "/tmp", data);
+
+    update_stats([this, &data](Stats& stats)
+    {
+        stats.size += data.size();
+        if (stats.size > max_size)
+        {
+            evict(stats);
+        }
+    });
+}
+
+std::future<CachedImage> BuildCache::get(const std::string &key)
+{
+    std::promise<CachedImage> result;
+    result.set_value(lookup(key));
+    return result.get_future();
+}
+
+void BuildCache::put(const std::string &key, gsl::span<const uint8_t> data)
+{
+    try
+    {
+        store(key, data);
+    }
+    catch (const io_error&)
+    {
+    }
+}
+
+BuildCache::Stats BuildCache::stats() const
+{
+    return read_stats(directory + "/stats");
+}
+
+std::string BuildCache::object_path(const std::string &key) const
+{
+    return directory + "/objects/" + key.substr(0, 2) + "/" + key.substr(2);
+}
+
+template <typename Func>
+void BuildCache::update_stats(Func &&func)
+{
+    const std::string lock_path = directory + "/lock";
+    int lock_fd = ::open(lock_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (lock_fd < 0)
+    {
+        io_error_throw("Could not open cache lock", lock_path);
+    }
+    ::flock(lock_fd, LOCK_EX);
+
+    try
+    {
+        const std::string stats_path = directory + "/stats";
+        Stats stats = read_stats(stats_path);
+        func(stats);
+
+        auto text = format_stats(stats);
+        write_file_atomically(stats_path, directory + "/tmp",
+                              gsl::span<const uint8_t>((const uint8_t*)text.data(), text.size()));
+    }
+    catch (...)
+    {
+        ::close(lock_fd);
+        throw;
+    }
+
+    ::close(lock_fd); // releases the lock
+}
+
+void BuildCache::evict(Stats& stats)
+{
+    struct Entry
+    {
+        fs::file_time_type mtime;
+        uint64_t size;
+        fs::path path;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t total { 0 };
+    std::error_code ec;
+    for (const auto& file : fs::recursive_directory_iterator(directory + "/objects", ec))
+    {
+        if (!file.is_regular_file(ec)) continue;
+
+        Entry entry { file.last_write_time(ec), file.file_size(ec), file.path() };
+        if (ec) continue;
+        total += entry.size;
+        entries.emplace_back(std::move(entry));
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs)
+    {
+        return lhs.mtime < rhs.mtime;
+    });
+
+    // go a bit below the limit so that the next stores don't evict again right away
+    const uint64_t target = max_size - max_size / 10;
+    for (const auto& entry : entries)
+    {
+        if (total <= target) break;
+        if (fs::remove(entry.path, ec))
+        {
+            total -= entry.size;
+        }
+    }
+
+    stats.size = total;
+}
+
+uint64_t parse_cache_size(const std::string &str)
+{
+    size_t end { 0 };
+    uint64_t value = std::stoull(str, &end);
+
+    if (end < str.size())
+    {
+        switch (toupper(str[end]))
+        {
+            case 'K': value <<= 10; break;
+            case 'M': value <<= 20; break;
+            case 'G': value <<= 30; break;
+            default:
+                throw std::invalid_argument("invalid size '" + str + "'");
+        }
+    }
+
+    return value;
+}
+
+}
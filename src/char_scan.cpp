@@ -0,0 +1,120 @@
+/*
+char_scan.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "char_scan.hpp"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define FLOATY_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace floaty
+{
+
+namespace
+{
+
+bool is_scanned_char(char c)
+{
+    return c == '"' || c == ';' || c == '/' || c == '\n';
+}
+
+#ifndef FLOATY_SCAN_X86
+uint64_t scan_block_scalar(const char* block)
+{
+    return scan_tail(block, scan_block_size);
+}
+#else
+uint64_t scan_block_sse2(const char* block)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i semicolon = _mm_set1_epi8(';');
+    const __m128i slash = _mm_set1_epi8('/');
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    uint64_t mask { 0 };
+    for (size_t i { 0 }; i < scan_block_size; i += 16)
+    {
+        const __m128i bytes = _mm_loadu_si128((const __m128i*)(block + i));
+        const __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, quote), _mm_cmpeq_epi8(bytes, semicolon)),
+                                           _mm_or_si128(_mm_cmpeq_epi8(bytes, slash), _mm_cmpeq_epi8(bytes, newline)));
+        mask |= uint64_t(uint16_t(_mm_movemask_epi8(found))) << i;
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+uint64_t scan_block_avx2(const char* block)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i semicolon = _mm256_set1_epi8(';');
+    const __m256i slash = _mm256_set1_epi8('/');
+    const __m256i newline = _mm256_set1_epi8('\n');
+
+    uint64_t mask { 0 };
+    for (size_t i { 0 }; i < scan_block_size; i += 32)
+    {
+        const __m256i bytes = _mm256_loadu_si256((const __m256i*)(block + i));
+        const __m256i found = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, quote),
+                                                              _mm256_cmpeq_epi8(bytes, semicolon)),
+                                              _mm256_or_si256(_mm256_cmpeq_epi8(bytes, slash),
+                                                              _mm256_cmpeq_epi8(bytes, newline)));
+        mask |= uint64_t(uint32_t(_mm256_movemask_epi8(found))) << i;
+    }
+    return mask;
+}
+#endif
+
+using ScanFunction = uint64_t (*)(const char*);
+
+ScanFunction select_scan_block()
+{
+#ifdef FLOATY_SCAN_X86
+    if (__builtin_cpu_supports("avx2")) return scan_block_avx2;
+    return scan_block_sse2;
+#else
+    return scan_block_scalar;
+#endif
+}
+
+}
+
+uint64_t scan_block(const char* block)
+{
+    static const ScanFunction scan = select_scan_block();
+    return scan(block);
+}
+
+uint64_t scan_tail(const char* data, size_t size)
+{
+    uint64_t mask { 0 };
+    for (size_t i { 0 }; i < size; ++i)
+    {
+        if (is_scanned_char(data[i])) mask |= uint64_t(1) << i;
+    }
+    return mask;
+}
+
+}
@@ -0,0 +1,111 @@
+/*
+dispatch_stats.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "dispatch_stats.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <unordered_map>
+
+namespace floaty
+{
+
+namespace
+{
+
+std::mutex stats_mutex;
+std::unordered_map<std::string, DispatchCounters> mnemonic_stats;
+
+double per_instruction(uint64_t count, uint64_t instructions)
+{
+    return instructions ? double(count) / instructions : 0;
+}
+
+}
+
+DispatchCounters& DispatchCounters::operator+=(const DispatchCounters& other)
+{
+    instructions += other.instructions;
+    probes += other.probes;
+    operand_checks += other.operand_checks;
+    conversions += other.conversions;
+    fallbacks += other.fallbacks;
+    unmatched += other.unmatched;
+    return *this;
+}
+
+void record_dispatch(std::string_view mnemonic, const DispatchCounters& counters)
+{
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    mnemonic_stats[std::string(mnemonic)] += counters;
+}
+
+DispatchReport dispatch_report()
+{
+    DispatchReport report;
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        report.mnemonics.assign(mnemonic_stats.begin(), mnemonic_stats.end());
+    }
+
+    for (const auto& mnemonic : report.mnemonics)
+    {
+        report.total += mnemonic.second;
+    }
+    std::sort(report.mnemonics.begin(), report.mnemonics.end(), [](const auto& lhs, const auto& rhs)
+    {
+        return lhs.second.probes != rhs.second.probes ? lhs.second.probes > rhs.second.probes : lhs.first < rhs.first;
+    });
+
+    return report;
+}
+
+void print_dispatch_report(const DispatchReport &report, std::ostream &stream)
+{
+    char line[200];
+    std::snprintf(line, sizeof(line), "%-12s %10s %10s %12s %10s %12s %10s %10s %10s\n", "mnemonic", "count",
+                  "probes", "probes/ins", "checks", "conversions", "conv/ins", "fallbacks", "unmatched");
+    stream << line;
+
+    auto print_row = [&line, &stream](const std::string& name, const DispatchCounters& counters)
+    {
+        std::snprintf(line, sizeof(line), "%-12s %10llu %10llu %12.1f %10llu %12llu %10.1f %10llu %10llu\n",
+                      name.c_str(), (unsigned long long)counters.instructions, (unsigned long long)counters.probes,
+                      per_instruction(counters.probes, counters.instructions),
+                      (unsigned long long)counters.operand_checks, (unsigned long long)counters.conversions,
+                      per_instruction(counters.conversions, counters.instructions),
+                      (unsigned long long)counters.fallbacks, (unsigned long long)counters.unmatched);
+        stream << line;
+    };
+
+    for (const auto& mnemonic : report.mnemonics)
+    {
+        print_row(mnemonic.first, mnemonic.second);
+    }
+    print_row("total", report.total);
+}
+
+}
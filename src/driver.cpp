@@ -0,0 +1,534 @@
+/*
+driver.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "driver.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <exception>
+#include <future>
+#include <fstream>
+#include <numeric>
+#include <optional>
+#include <thread>
+
+#include "source_file.hpp"
+#include "output_file.hpp"
+#include "preprocessor.hpp"
+#include "parser.hpp"
+#include "assembler.hpp"
+#include "thread_pool.hpp"
+#include "bounded_queue.hpp"
+#include "include_cache.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "stl_utils.hpp"
+
+namespace floaty
+{
+
+namespace
+{
+
+// preprocessed text assemble_source() hands to the parser at once
+constexpr size_t parse_batch_size = 16 * 1024;
+
+// Finds the ';' comments of 'source' and returns 'options' with them, for preprocess() to drop them
+PreprocessOptions find_source_comments(std::string_view source, const PreprocessOptions& options,
+                                       std::vector<size_t>& comments)
+{
+    ScopedPhase phase(Phase::PrePreprocess);
+    find_comments(source, comments);
+    phase.add_items(source.size());
+
+    PreprocessOptions source_options = options;
+    source_options.comments = comments;
+    return source_options;
+}
+
+}
+
+std::string preprocess_source(std::string_view source, const std::string &filename, const PreprocessOptions &options)
+{
+    std::vector<size_t> comments;
+    const auto source_options = find_source_comments(source, options, comments);
+
+    ScopedPhase phase(Phase::Preprocess);
+    auto preprocessed = preprocess(source, filename, source_options);
+    phase.add_items(preprocessed.size());
+    return preprocessed;
+}
+
+void assemble_preprocessed(std::string_view preprocessed, const std::string &filename, OutputSink &sink,
+                           ImageStats* stats)
+{
+    std::vector<AssemblerDirective> instructions;
+    {
+        ScopedPhase phase(Phase::Parse);
+        instructions = parse(preprocessed, filename);
+        phase.add_items(instructions.size());
+    }
+    assemble(instructions, sink, std::pmr::get_default_resource(), stats);
+}
+
+std::vector<uint8_t> assemble_preprocessed(std::string_view preprocessed, const std::string &filename)
+{
+    VectorSink sink;
+    assemble_preprocessed(preprocessed, filename, sink);
+    return std::move(sink.data);
+}
+
+void assemble_source(std::string_view source, const std::string &filename, const PreprocessOptions &options,
+                     OutputSink &sink, ImageStats* stats)
+{
+    std::vector<size_t> comments;
+    const auto source_options = find_source_comments(source, options, comments);
+
+    // The preprocessed text is never held whole, the parser takes it a batch of lines at a time. A parse error is
+    // kept until preprocessing succeeded, as the preprocessor errors come first when the stages run one by one.
+    IncrementalParser parser(filename);
+    std::vector<AssemblerDirective> instructions;
+    std::exception_ptr parse_error;
+    {
+        ScopedPhase phase(Phase::Preprocess);
+        preprocess(source, filename, source_options, parse_batch_size, [&](gsl::span<const PreprocessedLine> lines)
+        {
+            for (const auto& line : lines) phase.add_items(line.text.size() + 1);
+            if (parse_error) return;
+
+            try
+            {
+                ScopedPhase parse_phase(Phase::Parse);
+                const size_t count = instructions.size();
+                parser.parse(lines, instructions);
+                parse_phase.add_items(instructions.size() - count);
+            }
+            catch (...)
+            {
+                parse_error = std::current_exception();
+            }
+        });
+    }
+    if (parse_error) std::rethrow_exception(parse_error);
+
+    assemble(instructions, sink, std::pmr::get_default_resource(), stats);
+}
+
+std::vector<uint8_t> assemble_source(std::string_view source, const std::string &filename, const PreprocessOptions &options)
+{
+    VectorSink sink;
+    assemble_source(source, filename, options, sink);
+    return std::move(sink.data);
+}
+
+void assemble_source_pipelined(std::string_view source, const std::string &filename, const PreprocessOptions &options,
+                               OutputSink &sink, ImageStats* stats, const PipelineOptions& pipeline)
+{
+    std::vector<size_t> comments;
+    const auto source_options = find_source_comments(source, options, comments);
+
+    BoundedQueue<std::string> chunks(pipeline.queue_depth);
+    BoundedQueue<std::vector<AssemblerDirective>> batches(pipeline.queue_depth);
+    // A failed stage keeps draining its input so that the one before it never blocks, the errors are rethrown in
+    // the order the serial path would have met them
+    std::exception_ptr preprocess_error;
+    std::exception_ptr parse_error;
+    std::exception_ptr layout_error;
+
+    std::thread preprocessor([&]
+    {
+        TraceWriter::set_thread_name("preprocess");
+        try
+        {
+            ScopedPhase phase(Phase::Preprocess);
+            preprocess(source, filename, source_options, pipeline.chunk_size, [&chunks, &phase](std::string&& chunk)
+            {
+                phase.add_items(chunk.size());
+                phase.pause();
+                chunks.push(std::move(chunk));
+                phase.resume();
+            });
+        }
+        catch (...)
+        {
+            preprocess_error = std::current_exception();
+        }
+        chunks.close();
+    });
+
+    std::thread parser([&]
+    {
+        TraceWriter::set_thread_name("parse");
+        IncrementalParser incremental(filename);
+        std::string chunk;
+        std::vector<AssemblerDirective> batch;
+        auto parse_chunk = [&](bool last)
+        {
+            if (parse_error) return;
+            try
+            {
+                ScopedPhase phase(Phase::Parse);
+                last ? incremental.finish(batch) : incremental.parse(chunk, batch);
+                phase.add_items(batch.size());
+            }
+            catch (...)
+            {
+                parse_error = std::current_exception();
+                return;
+            }
+            if (!batch.empty()) batches.push(std::move(batch));
+            batch.clear();
+        };
+
+        while (chunks.pop(chunk)) parse_chunk(false);
+        parse_chunk(true);
+        batches.close();
+    });
+
+    IncrementalAssembler assembler;
+    std::vector<AssemblerDirective> batch;
+    while (batches.pop(batch))
+    {
+        if (layout_error) continue;
+        try
+        {
+            assembler.add(std::move(batch));
+        }
+        catch (...)
+        {
+            layout_error = std::current_exception();
+        }
+    }
+
+    preprocessor.join();
+    parser.join();
+    for (const auto& error : { preprocess_error, parse_error, layout_error })
+    {
+        if (error) std::rethrow_exception(error);
+    }
+
+    assembler.finish(sink, stats);
+}
+
+void write_output(const std::string &filename, gsl::span<const uint8_t> data)
+{
+    ScopedPhase phase(Phase::Write);
+    phase.add_items(data.size());
+
+    std::ofstream outstream(filename, std::ios::trunc | std::ios::binary);
+    if (!outstream.is_open())
+    {
+        io_error_throw("Could not open output file", filename);
+    }
+    outstream.write((const char*)data.data(), data.size());
+}
+
+namespace
+{
+
+// A job is run in two halves so that the cache lookup can travel while the thread does something else
+struct PreparedJob
+{
+    std::string preprocessed;
+    std::string key;
+    std::future<CachedImage> cached;
+    std::optional<ImageStats> stats;
+};
+
+// Preprocesses the source and starts the cache lookup
+void prepare_job(const Job& job, const JobServices& services, PreparedJob& prepared)
+{
+    TraceSpan span("prepare", job.input);
+
+    std::optional<SourceFile> file;
+    {
+        ScopedPhase phase(Phase::Read);
+        file.emplace(job.input);
+        phase.add_items(file->view().size());
+    }
+    const SourceFile& source = *file;
+
+    std::vector<IncludedFile> included_files;
+    PreprocessOptions options;
+    options.defines = job.defines;
+    options.loader = services.loader;
+    options.token_cache = services.token_cache;
+    options.prelude = services.prelude;
+    if (services.cache) options.included_files = &included_files;
+
+    prepared.preprocessed = preprocess_source(source.view(), job.input, options);
+
+    if (services.cache)
+    {
+        // sparse and flat files hold the same bytes, a segment container doesn't
+        const std::string variant = services.output_format == OutputFormat::Segments ? "segments" : "";
+        prepared.key = compute_cache_key(source.view(), job.input, job.defines, included_files, variant,
+                                         services.prelude ? services.prelude->digest : std::string_view{});
+        prepared.cached = services.cache->get(prepared.key);
+    }
+}
+
+// Writes the cached image, or assembles it if the lookup missed or didn't answer in time
+std::string finish_job(const Job& job, const JobServices& services, PreparedJob& prepared)
+{
+    TraceSpan span("finish", job.input);
+
+    if (services.cache)
+    {
+        if (prepared.cached.wait_for(services.cache_timeout) == std::future_status::ready)
+        {
+            if (auto cached = prepared.cached.get())
+            {
+                write_output(job.output, *cached);
+                return "Compilation successful to file " + job.output;
+            }
+        }
+    }
+
+    OutputFile output(job.output, services.output_format);
+    if (services.collect_stats) prepared.stats.emplace();
+    assemble_preprocessed(prepared.preprocessed, job.input, output, prepared.stats ? &*prepared.stats : nullptr);
+
+    if (services.cache)
+    {
+        // the cache stores the file as written
+        if (output.is_mapped())
+        {
+            services.cache->put(prepared.key, output.data());
+        }
+        else
+        {
+            services.cache->put(prepared.key, output.contents());
+        }
+    }
+    output.commit();
+
+    return "Compilation successful to file " + job.output;
+}
+
+// Without a cache there is nothing to look up between preprocessing and assembling, the preprocessed text goes
+// straight to the parser instead, and with JobServices::pipeline the stages overlap
+std::string run_uncached_job(const Job& job, const JobServices& services, std::optional<ImageStats>& stats)
+{
+    TraceSpan span(services.pipeline ? "pipeline" : "assemble", job.input);
+
+    std::optional<SourceFile> file;
+    {
+        ScopedPhase phase(Phase::Read);
+        file.emplace(job.input);
+        phase.add_items(file->view().size());
+    }
+
+    PreprocessOptions options;
+    options.defines = job.defines;
+    options.loader = services.loader;
+    options.token_cache = services.token_cache;
+    options.prelude = services.prelude;
+
+    OutputFile output(job.output, services.output_format);
+    if (services.collect_stats) stats.emplace();
+    if (services.pipeline)
+    {
+        assemble_source_pipelined(file->view(), job.input, options, output, stats ? &*stats : nullptr);
+    }
+    else
+    {
+        assemble_source(file->view(), job.input, options, output, stats ? &*stats : nullptr);
+    }
+    output.commit();
+
+    return "Compilation successful to file " + job.output;
+}
+
+}
+
+JobResult run_job(const Job &job, const JobServices& services)
+{
+    if (!services.cache)
+    {
+        std::optional<ImageStats> stats;
+        auto result = run_guarded([&job, &services, &stats]
+        {
+            return run_uncached_job(job, services, stats);
+        });
+        if (result.status == 0) result.stats = std::move(stats);
+        return result;
+    }
+
+    PreparedJob prepared;
+    auto result = run_guarded([&job, &services, &prepared]
+    {
+        prepare_job(job, services, prepared);
+        return finish_job(job, services, prepared);
+    });
+    if (result.status == 0) result.stats = std::move(prepared.stats);
+    return result;
+}
+
+JobResult run_precompile_job(const Job &job, const JobServices &services)
+{
+    return run_guarded([&job, &services]
+    {
+        TraceSpan span("precompile", job.input);
+
+        std::optional<SourceFile> file;
+        {
+            ScopedPhase phase(Phase::Read);
+            file.emplace(job.input);
+            phase.add_items(file->view().size());
+        }
+
+        PreprocessOptions options;
+        options.defines = job.defines;
+        options.loader = services.loader;
+        options.token_cache = services.token_cache;
+
+        PrecompiledHeader header;
+        {
+            // the header is run as an included file would be, its ';' comments aren't stripped
+            ScopedPhase phase(Phase::Preprocess);
+            header = precompile_header(file->view(), job.input, options);
+            phase.add_items(file->view().size());
+        }
+        {
+            ScopedPhase phase(Phase::Write);
+            save_precompiled_header(header, job.output);
+        }
+
+        return "Precompiled " + std::to_string(header.macros.size()) + " macros to file " + job.output;
+    });
+}
+
+JobResult run_guarded(const std::function<std::string ()> &func)
+{
+    try
+    {
+        return {0, func(), {}};
+    }
+    catch (const io_error& e)
+    {
+        return {-16, e.what(), {}};
+    }
+    catch (const pp_error& e)
+    {
+        return {-1, "Error during preprocessing : " + std::string(e.what()), {}};
+    }
+    catch (const std::exception& e)
+    {
+        return {-4, "Fatal exception : " + std::string(e.what()), {}};
+    }
+    catch (...)
+    {
+        return {-8, "Unknown exception caught", {}};
+    }
+}
+
+std::vector<JobResult> run_batch(gsl::span<const Job> jobs, size_t thread_count, JobServices services)
+{
+    std::vector<JobResult> results(jobs.size());
+    // the jobs of a batch usually share their headers
+    IncludeCache include_cache;
+    if (!services.loader) services.loader = &include_cache;
+
+    // Largest sources first so the long jobs don't end up last on a single core
+    std::vector<size_t> order(jobs.size());
+    std::vector<off_t> sizes(jobs.size(), 0);
+    std::iota(order.begin(), order.end(), 0);
+    for (size_t i { 0 }; i < order.size(); ++i)
+    {
+        struct stat st;
+        if (::stat(jobs[i].input.c_str(), &st) == 0) sizes[i] = st.st_size;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sizes](size_t lhs, size_t rhs)
+    {
+        return sizes[lhs] > sizes[rhs];
+    });
+
+    ThreadPool pool(std::min(thread_count, std::max<size_t>(jobs.size(), 1)));
+    for (size_t idx : order)
+    {
+        pool.submit([&pool, &jobs, &results, &services, idx]
+        {
+            if (!services.cache)
+            {
+                results[idx] = run_job(jobs[idx], services);
+                return;
+            }
+
+            auto prepared = std::make_shared<PreparedJob>();
+            results[idx] = run_guarded([&jobs, &services, &prepared, idx]
+            {
+                prepare_job(jobs[idx], services, *prepared);
+                return std::string{};
+            });
+            if (results[idx].status != 0) return;
+
+            // queued behind the jobs still waiting to be preprocessed, the lookups are pipelined meanwhile
+            pool.submit([&jobs, &results, &services, prepared, idx]
+            {
+                results[idx] = run_guarded([&jobs, &services, &prepared, idx]
+                {
+                    return finish_job(jobs[idx], services, *prepared);
+                });
+                if (results[idx].status == 0) results[idx].stats = std::move(prepared->stats);
+            });
+        });
+    }
+    pool.wait();
+
+    return results;
+}
+
+std::vector<Job> read_manifest(const std::string &filename)
+{
+    std::ifstream stream(filename);
+    if (!stream.is_open())
+    {
+        io_error_throw("Could not open manifest file", filename);
+    }
+
+    std::vector<Job> jobs;
+    std::string line;
+    unsigned line_number { 0 };
+    while (std::getline(stream, line))
+    {
+        ++line_number;
+        auto content = trim(line);
+        if (content.empty() || content.front() == '#') continue;
+
+        auto fields = split(content, " \t");
+        if (fields.size() != 2)
+        {
+            io_error_throw("Malformed manifest entry at line " + std::to_string(line_number), filename);
+        }
+
+        jobs.push_back({std::string(unquoted(fields[0])), std::string(unquoted(fields[1])), {}});
+    }
+
+    return jobs;
+}
+
+}
@@ -0,0 +1,147 @@
+/*
+floatyasm.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "floatyasm.hpp"
+
+#include <filesystem>
+
+#include "driver.hpp"
+#include "source_file.hpp"
+
+namespace floaty
+{
+
+namespace
+{
+
+std::string normalized(const std::string& path)
+{
+    return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+}
+
+void VirtualFileSystem::add_file(const std::string &filename, std::string contents)
+{
+    files[normalized(filename)] = std::make_shared<const std::string>(std::move(contents));
+}
+
+std::shared_ptr<const std::string> VirtualFileSystem::load(const std::string &filename)
+{
+    auto it = files.find(filename);
+    if (it != files.end())
+    {
+        return it->second;
+    }
+
+    return fallback ? fallback->load(filename) : nullptr;
+}
+
+bool VirtualFileSystem::locate(const std::string &name, const std::string &includer, std::string &resolved)
+{
+    const std::filesystem::path path(name);
+    std::vector<std::string> candidates;
+    if (path.is_relative())
+    {
+        candidates.emplace_back(normalized((std::filesystem::path(includer).parent_path() / path).string()));
+    }
+    candidates.emplace_back(normalized(name));
+
+    for (const auto& candidate : candidates)
+    {
+        if (files.count(candidate))
+        {
+            resolved = candidate;
+            return true;
+        }
+    }
+
+    return fallback && fallback->locate(name, includer, resolved);
+}
+
+AssembleResult assemble_text(std::string_view source, const AssembleOptions &options, OutputSink &sink)
+{
+    AssembleResult result;
+
+    std::vector<IncludedFile> included_files;
+    PreprocessOptions pp_options;
+    pp_options.defines = options.defines;
+    pp_options.loader = options.includes;
+    pp_options.token_cache = options.token_cache;
+    pp_options.prelude = options.prelude;
+    pp_options.included_files = &included_files;
+
+    try
+    {
+        if (options.context)
+        {
+            options.context->assemble(source, options.filename, pp_options, sink, options.stats);
+        }
+        else
+        {
+            assemble_source(source, options.filename, pp_options, sink, options.stats);
+        }
+    }
+    catch (const io_error& e)
+    {
+        result.diagnostics.push_back({Diagnostic::Kind::Io, e.what()});
+    }
+    catch (const pp_error& e)
+    {
+        result.diagnostics.push_back({Diagnostic::Kind::Preprocessor, e.what()});
+    }
+    catch (const assembler_error& e)
+    {
+        result.diagnostics.push_back({Diagnostic::Kind::Assembler, e.what()});
+    }
+    catch (const std::exception& e)
+    {
+        result.diagnostics.push_back({Diagnostic::Kind::Internal, e.what()});
+    }
+    catch (...)
+    {
+        result.diagnostics.push_back({Diagnostic::Kind::Internal, "Unknown exception caught"});
+    }
+
+    for (const auto& file : included_files)
+    {
+        result.included_files.emplace_back(file.filename);
+    }
+
+    return result;
+}
+
+AssembleResult assemble_text(std::string_view source, const AssembleOptions &options)
+{
+    VectorSink sink;
+    auto result = assemble_text(source, options, sink);
+    if (result.success())
+    {
+        result.image = std::move(sink.data);
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,106 @@
+/*
+image_stats.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "image_stats.hpp"
+
+#include <cstdio>
+
+namespace floaty
+{
+
+namespace
+{
+
+std::string quoted(std::string_view str)
+{
+    std::string result = "\"";
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\') result += '\\';
+        result += c;
+    }
+    return result + "\"";
+}
+
+}
+
+void print_image_stats_json(const ImageStats &stats, std::ostream &stream, std::string_view input)
+{
+    stream << "{\n";
+    if (!input.empty()) stream << "  \"input\": " << quoted(input) << ",\n";
+
+    uint64_t data_bytes { 0 };
+    for (const auto& directive : stats.data_bytes) data_bytes += directive.second;
+
+    stream << "  \"instructions\": " << stats.instructions << ",\n"
+           << "  \"code_bytes\": " << stats.code_bytes << ",\n"
+           << "  \"data_bytes\": " << data_bytes << ",\n"
+           << "  \"data_bytes_by_directive\": {";
+    bool first { true };
+    for (const auto& directive : stats.data_bytes)
+    {
+        stream << (first ? "" : ", ") << quoted(directive.first) << ": " << directive.second;
+        first = false;
+    }
+
+    char ratio[32];
+    std::snprintf(ratio, sizeof(ratio), "%.2f", stats.dups ? double(stats.dup_repetitions) / stats.dups : 0.0);
+    stream << "},\n"
+           << "  \"seeks\": " << stats.seeks << ",\n"
+           << "  \"seek_skipped_bytes\": " << stats.seek_skipped_bytes << ",\n"
+           << "  \"dups\": " << stats.dups << ",\n"
+           << "  \"dup_repetitions\": " << stats.dup_repetitions << ",\n"
+           << "  \"dup_mean_repetitions\": " << ratio << ",\n"
+           << "  \"dup_max_repetitions\": " << stats.dup_max_repetitions << ",\n"
+           << "  \"dup_bytes\": " << stats.dup_bytes << ",\n"
+           << "  \"labels\": " << stats.labels << ",\n"
+           << "  \"highest_address\": "
+           << (stats.highest_address ? std::to_string(*stats.highest_address) : std::string("null")) << ",\n"
+           << "  \"image_size\": " << stats.image_size << ",\n";
+
+    // the same mnemonic can come from several opcodes, e.g. LD
+    std::map<std::string_view, uint64_t> mnemonics;
+    for (const auto& opcode : stats.opcodes) mnemonics[opcode.mnemonic] += opcode.count;
+
+    stream << "  \"mnemonics\": {";
+    first = true;
+    for (const auto& mnemonic : mnemonics)
+    {
+        stream << (first ? "" : ", ") << quoted(mnemonic.first) << ": " << mnemonic.second;
+        first = false;
+    }
+
+    stream << "},\n  \"opcodes\": [";
+    first = true;
+    for (const auto& opcode : stats.opcodes)
+    {
+        stream << (first ? "\n" : ",\n") << "    {\"pattern\": " << quoted(opcode.pattern)
+               << ", \"format\": " << quoted(opcode.format) << ", \"count\": " << opcode.count << "}";
+        first = false;
+    }
+    stream << (first ? "]\n" : "\n  ]\n") << "}";
+}
+
+}
@@ -0,0 +1,93 @@
+/*
+include_cache.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "include_cache.hpp"
+
+#include <sys/stat.h>
+
+namespace floaty
+{
+
+std::shared_ptr<const std::string> IncludeCache::load(const std::string &filename)
+{
+    struct stat st;
+    if (::stat(filename.c_str(), &st) != 0)
+    {
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(filename);
+        if (it != entries.end())
+        {
+            auto& entry = it->second;
+            if (entry.size == st.st_size &&
+                entry.mtime.tv_sec == st.st_mtim.tv_sec && entry.mtime.tv_nsec == st.st_mtim.tv_nsec)
+            {
+                lru.splice(lru.begin(), lru, entry.lru_pos);
+                return entry.contents;
+            }
+
+            // stale
+            total_bytes -= entry.contents->size();
+            lru.erase(entry.lru_pos);
+            entries.erase(it);
+        }
+    }
+
+    auto contents = IncludeLoader::load(filename);
+    if (!contents)
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (entries.count(filename))
+    {
+        // loaded concurrently by another thread
+        return contents;
+    }
+
+    lru.push_front(filename);
+    entries[filename] = Entry{contents, st.st_size, st.st_mtim, lru.begin()};
+    total_bytes += contents->size();
+    evict();
+
+    return contents;
+}
+
+void IncludeCache::evict()
+{
+    while (total_bytes > max_bytes && lru.size() > 1)
+    {
+        auto it = entries.find(lru.back());
+        total_bytes -= it->second.contents->size();
+        entries.erase(it);
+        lru.pop_back();
+    }
+}
+
+}
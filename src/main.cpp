@@ -1,9 +1,109 @@
 #include <iostream>
-#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
 
-#include "preprocessor.hpp"
-#include "parser.hpp"
-#include "assembler.hpp"
+#include "driver.hpp"
+#include "image_stats.hpp"
+#include "dispatch_stats.hpp"
+#include "output_file.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "build_cache.hpp"
+#include "remote_cache.hpp"
+#include "token_cache.hpp"
+#include "precompiled_header.hpp"
+#include "server.hpp"
+#include "source_file.hpp"
+#include "thread_pool.hpp"
+
+namespace
+{
+
+void print_usage()
+{
+    std::cout << "FloatyChip Assembler 0.0.1\n";
+    std::cout << "Usage : FloatyChipAsm [-D <name[=value]>...] <input_file> <output_file>\n";
+    std::cout << "        FloatyChipAsm [-j <threads>] --batch <input_file> <output_file> [<input_file> <output_file>...]\n";
+    std::cout << "        FloatyChipAsm [-j <threads>] --manifest <manifest_file>\n";
+    std::cout << "        FloatyChipAsm [-D <name[=value]>...] --precompile-header <header_file> <output_file>\n";
+    std::cout << "        FloatyChipAsm --serve <socket_path>\n";
+    std::cout << "A manifest lists one \"<input_file> <output_file>\" pair per line.\n";
+    std::cout << "Options : --cache-dir <dir>     reuse the images assembled from identical inputs, stored in <dir>\n";
+    std::cout << "          --cache-size <size>   maximum size of the cache (default 256M), e.g. 4096, 512K, 64M, 2G\n";
+    std::cout << "          --cache-stats         print the hit/miss counters and size of the cache, then exit\n";
+    std::cout << "          --remote-cache <url>  use a shared cache server instead, unix:<path> or http://<host>:<port>\n";
+    std::cout << "          --remote-cache-timeout <ms>  assemble locally when the server takes longer (default 250)\n";
+    std::cout << "          --token-cache <dir>   replay the tokens of the included files lexed by earlier runs, stored\n";
+    std::cout << "                                in <dir>\n";
+    std::cout << "          --include-pch <file>  start every input with the macros of a header built by --precompile-header,\n";
+    std::cout << "                                as if it included it first; the -D options must be the same\n";
+    std::cout << "          --output-format <fmt> sparse (default), flat or segments, see output_file.hpp\n";
+    std::cout << "          --pipeline            preprocess, parse and assemble each input on separate threads at once,\n";
+    std::cout << "                                for large sources; ignored for jobs that use a cache\n";
+    std::cout << "          --time-report[=json]  print the time spent in each phase on stderr, as a table or as JSON\n";
+    std::cout << "          --stats=json          print what each image is made of on stderr : opcode and mnemonic counts,\n";
+    std::cout << "                                code and data bytes, SEEK gaps, DUP expansions, labels, highest address\n";
+    std::cout << "          --perf-counters       add the cycles, instructions, branch and cache misses of each phase\n";
+    std::cout << "                                to --time-report, from Linux perf events\n";
+    std::cout << "          --dispatch-stats      print how each mnemonic was matched against the opcode table on stderr,\n";
+    std::cout << "                                needs a build configured with -DFLOATY_DISPATCH_STATS=ON\n";
+    std::cout << "          --trace=<file>        write a Chrome trace-event JSON file of every phase and include\n";
+    std::cout << "--serve keeps the assembler running and answers requests on a Unix domain socket.\n";
+}
+
+void print_time_report(const floaty::Profiler& profiler, const std::string& format)
+{
+    if (format == "json")
+    {
+        profiler.print_json(std::cerr);
+    }
+    else
+    {
+        profiler.print_text(std::cerr);
+    }
+}
+
+// One JSON object per job that succeeded, in an array for batches. Cached images weren't encoded, so only their
+// input is listed.
+void print_stats(gsl::span<const floaty::Job> jobs, gsl::span<const floaty::JobResult> results, bool batch)
+{
+    if (batch) std::cerr << "[\n";
+    bool first { true };
+    for (size_t i { 0 }; i < (size_t)results.size(); ++i)
+    {
+        if (results[i].status != 0) continue;
+
+        if (!first) std::cerr << ",\n";
+        first = false;
+        if (results[i].stats)
+        {
+            floaty::print_image_stats_json(*results[i].stats, std::cerr, jobs[i].input);
+        }
+        else
+        {
+            std::cerr << "{\"input\": \"" << jobs[i].input << "\", \"cached\": true}";
+        }
+    }
+    if (!first) std::cerr << "\n";
+    if (batch) std::cerr << "]\n";
+}
+
+int report(const floaty::JobResult& result)
+{
+    if (result.status == 0)
+    {
+        std::cout << result.message << "\n";
+    }
+    else
+    {
+        std::cerr << result.message << std::endl;
+    }
+
+    return result.status;
+}
+
+}
 
 int main(int argc, char *argv[])
 {
@@ -21,43 +121,281 @@ int main(int argc, char *argv[])
 
         if (arguments[0] == std::string("-h") || arguments[0] == std::string("--help"))
         {
-            std::cout << "FloatyChip Assembler 0.0.1\n";
-            std::cout << "Usage : FloatyChipAsm <input_file> <output_file>\n";
+            print_usage();
             return 0;
         }
 
-        infile = arguments[0];
-        if (arguments.size() >= 2)
+        bool batch_mode { false };
+        size_t thread_count { floaty::ThreadPool::default_thread_count() };
+        std::vector<floaty::Job> jobs;
+        std::vector<std::string> defines;
+        std::vector<std::string> positional;
+        std::string cache_dir;
+        uint64_t cache_size { 256 << 20 };
+        bool print_cache_stats { false };
+        std::string remote_cache;
+        long remote_cache_timeout { 250 };
+        std::string token_cache_dir;
+        std::string prelude_file;
+        bool precompile { false };
+        floaty::OutputFormat output_format { floaty::OutputFormat::Sparse };
+        std::string time_report;
+        std::string trace_file;
+        bool perf_counters { false };
+        bool dispatch_stats { false };
+        bool image_stats { false };
+        bool pipeline { false };
+        std::vector<std::string> args(arguments.begin(), arguments.end());
+
+        for (size_t i { 0 }; i < args.size(); ++i)
         {
-            outfile = arguments[1];
+            std::string arg = args[i];
+            if ((arg == "-j" || arg == "--jobs") && i + 1 < args.size())
+            {
+                thread_count = std::stoul(args[++i]);
+            }
+            else if (arg == "-D" && i + 1 < args.size())
+            {
+                defines.emplace_back(args[++i]);
+            }
+            else if (arg.size() > 2 && arg.compare(0, 2, "-D") == 0)
+            {
+                defines.emplace_back(arg.substr(2));
+            }
+            else if (arg == "--cache-dir" && i + 1 < args.size())
+            {
+                cache_dir = args[++i];
+            }
+            else if (arg == "--cache-size" && i + 1 < args.size())
+            {
+                cache_size = floaty::parse_cache_size(args[++i]);
+            }
+            else if (arg == "--remote-cache" && i + 1 < args.size())
+            {
+                remote_cache = args[++i];
+            }
+            else if (arg == "--remote-cache-timeout" && i + 1 < args.size())
+            {
+                remote_cache_timeout = std::stol(args[++i]);
+            }
+            else if (arg == "--token-cache" && i + 1 < args.size())
+            {
+                token_cache_dir = args[++i];
+            }
+            else if (arg == "--include-pch" && i + 1 < args.size())
+            {
+                prelude_file = args[++i];
+            }
+            else if (arg == "--precompile-header")
+            {
+                precompile = true;
+            }
+            else if (arg == "--output-format" && i + 1 < args.size())
+            {
+                output_format = floaty::parse_output_format(args[++i]);
+            }
+            else if (arg == "--time-report" || arg == "--time-report=text" || arg == "--time-report=json")
+            {
+                time_report = arg == "--time-report=json" ? "json" : "text";
+            }
+            else if (arg == "--perf-counters")
+            {
+                perf_counters = true;
+                if (time_report.empty()) time_report = "text";
+            }
+            else if (arg == "--stats" || arg == "--stats=json")
+            {
+                image_stats = true;
+            }
+            else if (arg == "--pipeline")
+            {
+                pipeline = true;
+            }
+            else if (arg == "--dispatch-stats")
+            {
+                dispatch_stats = true;
+            }
+            else if (arg.compare(0, 8, "--trace=") == 0 && arg.size() > 8)
+            {
+                trace_file = arg.substr(8);
+            }
+            else if (arg == "--trace" && i + 1 < args.size())
+            {
+                trace_file = args[++i];
+            }
+            else if (arg == "--cache-stats")
+            {
+                print_cache_stats = true;
+            }
+            else if (arg == "--serve" && i + 1 < args.size())
+            {
+                return floaty::serve(args[++i]);
+            }
+            else if (arg == "--batch")
+            {
+                batch_mode = true;
+            }
+            else if (arg == "--manifest" && i + 1 < args.size())
+            {
+                batch_mode = true;
+                auto manifest_jobs = floaty::read_manifest(args[++i]);
+                jobs.insert(jobs.end(), manifest_jobs.begin(), manifest_jobs.end());
+            }
+            else
+            {
+                positional.emplace_back(std::move(arg));
+            }
         }
 
-        std::ifstream instream(infile);
-        std::string instring;
+        if (!cache_dir.empty() && !remote_cache.empty())
+        {
+            std::cerr << "--cache-dir and --remote-cache can't be used together" << std::endl;
+            return -16;
+        }
 
-        if (!instream.is_open()) {
-            std::cerr << "Could not open input file: " << argv[1] << std::endl;
+        std::optional<floaty::Profiler> profiler;
+        if (!time_report.empty())
+        {
+            profiler.emplace();
+            floaty::Profiler::set_active(&*profiler);
+
+            std::string reason;
+            if (perf_counters && !profiler->enable_hardware_counters(reason))
+            {
+                std::cerr << "Hardware counters unavailable (" << reason << "), reporting times only" << std::endl;
+            }
+        }
+
+        if (dispatch_stats && !floaty::dispatch_stats_enabled)
+        {
+            std::cerr << "--dispatch-stats requires a build configured with -DFLOATY_DISPATCH_STATS=ON" << std::endl;
             return -16;
         }
-        instream.unsetf(std::ios::skipws);
-        instring = std::string(std::istreambuf_iterator<char>(instream.rdbuf()),
-                               std::istreambuf_iterator<char>());
 
-        floaty::pre_preprocess(instring);
-        std::string str = floaty::preprocess(instring, infile);
+        std::optional<floaty::TraceWriter> tracer;
+        if (!trace_file.empty())
+        {
+            tracer.emplace();
+            floaty::TraceWriter::set_active(&*tracer);
+        }
+
+        std::optional<floaty::BuildCache> cache;
+        std::optional<floaty::RemoteCache> shared_cache;
+        std::optional<floaty::TokenCache> token_cache;
+        std::optional<floaty::PrecompiledHeader> prelude;
+        floaty::JobServices services;
+        services.output_format = output_format;
+        services.collect_stats = image_stats;
+        services.pipeline = pipeline;
+        if (!cache_dir.empty())
+        {
+            cache.emplace(cache_dir, cache_size);
+            services.cache = &*cache;
+        }
+        if (!token_cache_dir.empty())
+        {
+            token_cache.emplace(token_cache_dir);
+            services.token_cache = &*token_cache;
+        }
+        if (!prelude_file.empty())
+        {
+            prelude = floaty::load_precompiled_header(prelude_file);
+            floaty::check_precompiled_header(*prelude);
+            services.prelude = &*prelude;
+        }
+        if (!remote_cache.empty())
+        {
+            // an unreachable server only means every lookup misses
+            shared_cache.emplace(floaty::parse_endpoint(remote_cache), std::chrono::milliseconds(remote_cache_timeout));
+            services.cache = &*shared_cache;
+            services.cache_timeout = std::chrono::milliseconds(remote_cache_timeout);
+        }
+
+        if (print_cache_stats)
+        {
+            if (!cache)
+            {
+                std::cerr << "--cache-stats requires --cache-dir" << std::endl;
+                return -16;
+            }
+            auto stats = cache->stats();
+            std::cout << "cache directory : " << cache->path() << "\n";
+            std::cout << "hits            : " << stats.hits << "\n";
+            std::cout << "misses          : " << stats.misses << "\n";
+            std::cout << "size            : " << stats.size << " bytes\n";
+            return 0;
+        }
+
+        if (precompile)
+        {
+            if (positional.size() != 2)
+            {
+                std::cerr << "--precompile-header expects <header_file> <output_file>" << std::endl;
+                return -16;
+            }
+
+            const auto result = floaty::run_precompile_job({positional[0], positional[1], defines}, services);
+            int status = report(result);
+            if (profiler) print_time_report(*profiler, time_report);
+            if (tracer) tracer->write(trace_file);
+            return status;
+        }
 
-        auto instructions = floaty::parse(str, infile);
-        auto data = floaty::assemble(instructions);
+        if (!batch_mode)
+        {
+            if (positional.empty())
+            {
+                std::cerr << "No input file" << std::endl;
+                return -16;
+            }
+
+            infile = positional[0];
+            if (positional.size() >= 2)
+            {
+                outfile = positional[1];
+            }
+
+            const floaty::Job job { infile, outfile, defines };
+            const auto result = floaty::run_job(job, services);
+            int status = report(result);
+            if (image_stats) print_stats(gsl::make_span(&job, 1), gsl::make_span(&result, 1), false);
+            if (profiler) print_time_report(*profiler, time_report);
+            if (dispatch_stats) floaty::print_dispatch_report(floaty::dispatch_report(), std::cerr);
+            if (tracer) tracer->write(trace_file);
+            return status;
+        }
 
-        std::ofstream outstream(outfile, std::ios::trunc | std::ios::binary);
-        outstream.write((const char*)data.data(), data.size());
+        if (positional.size() % 2 != 0)
+        {
+            std::cerr << "Batch mode expects <input_file> <output_file> pairs" << std::endl;
+            return -16;
+        }
+        for (size_t i { 0 }; i < positional.size(); i += 2)
+        {
+            jobs.push_back({positional[i], positional[i + 1], {}});
+        }
+        for (auto& job : jobs)
+        {
+            job.defines.insert(job.defines.end(), defines.begin(), defines.end());
+        }
 
-        std::cout << "Compilation successful to file " << outfile << "\n";
+        int status { 0 };
+        const auto results = floaty::run_batch(jobs, thread_count, services);
+        for (const auto& result : results)
+        {
+            int job_status = report(result);
+            if (status == 0) status = job_status;
+        }
+        if (image_stats) print_stats(jobs, results, true);
+        if (profiler) print_time_report(*profiler, time_report);
+        if (dispatch_stats) floaty::print_dispatch_report(floaty::dispatch_report(), std::cerr);
+        if (tracer) tracer->write(trace_file);
+        return status;
     }
-    catch (const floaty::pp_error& e)
+    catch (const floaty::io_error& e)
     {
-        std::cerr << "Error during preprocessing : " + std::string(e.what()) << std::endl;
-        return -1;
+        std::cerr << e.what() << std::endl;
+        return -16;
     }
     catch (const std::exception& e)
     {
@@ -0,0 +1,292 @@
+/*
+output_file.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "output_file.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+
+#include "source_file.hpp"
+#include "profiler.hpp"
+
+namespace floaty
+{
+
+namespace
+{
+
+void write_all(int fd, const uint8_t* data, size_t size, const std::string& filename)
+{
+    while (size > 0)
+    {
+        ssize_t count = ::write(fd, data, size);
+        if (count < 0)
+        {
+            if (errno == EINTR) continue;
+            io_error_throw("Could not write output file", filename);
+        }
+        data += count;
+        size -= count;
+    }
+}
+
+void write_zeroes(int fd, size_t size, const std::string& filename)
+{
+    static const uint8_t zeroes[64*1024] = {};
+    while (size > 0)
+    {
+        const size_t count = std::min(size, sizeof(zeroes));
+        write_all(fd, zeroes, count, filename);
+        size -= count;
+    }
+}
+
+void append_le32(std::vector<uint8_t>& data, uint32_t value)
+{
+    for (size_t i { 0 }; i < 4; ++i)
+    {
+        data.emplace_back(value & 0xFF);
+        value >>= 8;
+    }
+}
+
+}
+
+OutputFormat parse_output_format(const std::string &str)
+{
+    if (str == "sparse") return OutputFormat::Sparse;
+    if (str == "flat") return OutputFormat::Flat;
+    if (str == "segments") return OutputFormat::Segments;
+
+    throw std::invalid_argument("invalid output format '" + str + "'");
+}
+
+const char *output_format_name(OutputFormat format)
+{
+    switch (format)
+    {
+        case OutputFormat::Sparse: return "sparse";
+        case OutputFormat::Flat: return "flat";
+        case OutputFormat::Segments: return "segments";
+    }
+    __builtin_unreachable();
+}
+
+OutputFile::OutputFile(std::string filename, OutputFormat format)
+    : filename(std::move(filename)), format(format)
+{
+}
+
+OutputFile::~OutputFile()
+{
+    release();
+    if (!tmp_filename.empty())
+    {
+        // never committed, the assembly failed
+        ::unlink(tmp_filename.c_str());
+    }
+}
+
+gsl::span<uint8_t> OutputFile::allocate(size_t size)
+{
+    ImageLayout flat;
+    flat.size = size;
+    if (size > 0) flat.segments.push_back({0, size});
+
+    auto buffers = allocate_segments(flat);
+    return buffers.empty() ? gsl::span<uint8_t>{} : buffers.front();
+}
+
+std::vector<gsl::span<uint8_t>> OutputFile::allocate_segments(const ImageLayout &layout)
+{
+    if (format == OutputFormat::Sparse && map(layout))
+    {
+        return segment_views(image, layout);
+    }
+
+    return segments.allocate_segments(layout);
+}
+
+bool OutputFile::map(const ImageLayout& layout)
+{
+    struct stat st;
+    const bool exists = ::stat(filename.c_str(), &st) == 0;
+    if ((exists && !S_ISREG(st.st_mode)) || layout.size == 0) return false;
+
+    // renaming over a symlink would replace it, the file it points to is replaced instead
+    target_filename = filename;
+    if (exists)
+    {
+        char* resolved = ::realpath(filename.c_str(), nullptr);
+        if (!resolved) return false;
+        target_filename = resolved;
+        std::free(resolved);
+    }
+    else if (::lstat(filename.c_str(), &st) == 0)
+    {
+        // a dangling symlink, written through by commit()
+        return false;
+    }
+
+    std::string tmp = target_filename + ".tmp" + std::to_string(::getpid()) + "."
+            + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+    fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0)
+    {
+        io_error_throw("Could not open output file", filename);
+    }
+    tmp_filename = std::move(tmp);
+
+    // the new file replaces the old one with its permissions, as writing to it in place would
+    if (exists && ::fchmod(fd, st.st_mode & 07777) != 0)
+    {
+        io_error_throw("Could not set the permissions of output file", filename);
+    }
+
+    // the file grows as a hole, the mapping reads as zeroes until written
+    if (::ftruncate(fd, layout.size) != 0)
+    {
+        io_error_throw("Could not resize output file", filename);
+    }
+
+    void* addr = ::mmap(nullptr, layout.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        // not mappable, fall back to writing the segments
+        release();
+        ::unlink(tmp_filename.c_str());
+        tmp_filename.clear();
+        return false;
+    }
+
+    mapping = addr;
+    image = gsl::span<uint8_t>(static_cast<uint8_t*>(addr), layout.size);
+    return true;
+}
+
+std::vector<uint8_t> OutputFile::contents() const
+{
+    if (mapping)
+    {
+        return std::vector<uint8_t>(image.begin(), image.end());
+    }
+    if (format != OutputFormat::Segments)
+    {
+        return segments.flatten();
+    }
+
+    const auto& layout = segments.layout;
+    std::vector<uint8_t> container { 'F', 'C', 'S', 'G' };
+    append_le32(container, 1);
+    append_le32(container, layout.size);
+    append_le32(container, layout.segments.size());
+    for (const auto& segment : layout.segments)
+    {
+        append_le32(container, segment.address);
+        append_le32(container, segment.size);
+    }
+    container.insert(container.end(), segments.data.begin(), segments.data.end());
+
+    return container;
+}
+
+void OutputFile::commit()
+{
+    ScopedPhase phase(Phase::Write);
+    phase.add_items(mapping ? image.size() : segments.layout.size);
+
+    if (mapping)
+    {
+        release();
+        image = {};
+        if (std::rename(tmp_filename.c_str(), target_filename.c_str()) != 0)
+        {
+            io_error_throw("Could not write output file", filename);
+        }
+        tmp_filename.clear();
+        return;
+    }
+
+    int out = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (out < 0)
+    {
+        io_error_throw("Could not open output file", filename);
+    }
+
+    try
+    {
+        if (format == OutputFormat::Segments)
+        {
+            auto container = contents();
+            write_all(out, container.data(), container.size(), filename);
+        }
+        else
+        {
+            // stream the gaps instead of building the flat image
+            const auto& layout = segments.layout;
+            size_t position { 0 };
+            for (size_t i { 0 }; i < layout.segments.size(); ++i)
+            {
+                write_zeroes(out, layout.segments[i].address - position, filename);
+                auto bytes = segments.segment_data(i);
+                write_all(out, bytes.data(), bytes.size(), filename);
+                position = layout.segments[i].address + layout.segments[i].size;
+            }
+            write_zeroes(out, layout.size - position, filename);
+        }
+    }
+    catch (...)
+    {
+        ::close(out);
+        throw;
+    }
+
+    ::close(out);
+}
+
+void OutputFile::release()
+{
+    if (mapping)
+    {
+        ::munmap(mapping, image.size());
+        mapping = nullptr;
+    }
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+}
@@ -29,6 +29,7 @@ SOFTWARE.
 
 #include <gsl/gsl_span.hpp>
 
+#include <algorithm>
 #include <optional>
 #include <iostream>
 
@@ -37,10 +38,11 @@ SOFTWARE.
 namespace floaty
 {
 
-std::optional<Label> pending_label;
-
-void handle_line_directive(gsl::span<std::string_view> toks, unsigned& line, std::string& filename)
+void handle_line_directive(gsl::span<std::string_view> toks, ParserState& state)
 {
+    unsigned& line = state.line;
+    std::string& filename = state.filename;
+
     if (toks.size() != 2 && toks.size() != 3)
     {
         parser_error_throw("malformed #line directive", line, filename);
@@ -65,93 +67,167 @@ void handle_line_directive(gsl::span<std::string_view> toks, unsigned& line, std
     }
 }
 
-Instruction handle_instruction(gsl::span<std::string_view> toks, unsigned& line, std::string& filename)
+void handle_instruction(gsl::span<std::string_view> toks, ParserState& state, Instruction& ins)
 {
-    Instruction ins;
-    std::optional<Label> label = pending_label;
+    std::optional<Label>& label = state.pending_label;
 
     if (toks[0].back() == ':')
     {
         if (label)
         {
-            parser_error_throw("an instruction can only have one label", line, filename);
+            parser_error_throw("an instruction can only have one label", state.line, state.filename);
         }
         label = Label{};
         label->name = toks[0].substr(0, toks[0].size()-1); // minus the ':'
         toks = toks.subspan<1>();
     }
 
-    if (label)
+    if (toks.empty())
     {
-        ins.label = label;
-        pending_label.reset();
+        parser_error_throw("invalid instruction", state.line, state.filename);
     }
 
-    if (toks.empty())
+    // 'ins' may be left over from a previous parse, assign its strings instead of replacing them to reuse their memory
+    if (label)
     {
-        parser_error_throw("invalid instruction", line, filename);
+        if (!ins.label) ins.label.emplace();
+        ins.label->name = label->name;
+        label.reset();
+    }
+    else
+    {
+        ins.label.reset();
     }
 
-    ins.mnemo = to_upper(std::string(toks[0]));
+    ins.mnemo = toks[0];
+    for (auto& c : ins.mnemo) c = toupper(c);
     toks = toks.subspan<1>();
-    ins.arguments = std::vector<std::string>{toks.begin(), toks.end()};
-    ins.line = line;
-    ins.filename = filename;
-
-    ++line;
+    ins.arguments.resize(toks.size());
+    for (size_t i { 0 }; i < (size_t)toks.size(); ++i)
+    {
+        ins.arguments[i] = toks[i];
+    }
+    ins.line = state.line;
+    ins.filename = state.filename;
 
-    return ins;
+    ++state.line;
 }
 
-void handle_lone_label(gsl::span<std::string_view> toks, unsigned& line, std::string&)
+void handle_lone_label(gsl::span<std::string_view> toks, ParserState& state)
 {
-    pending_label = Label{};
-    pending_label->name = toks[0].substr(0, toks[0].size() - 1); // minus the :
+    state.pending_label = Label{};
+    state.pending_label->name = toks[0].substr(0, toks[0].size() - 1); // minus the :
 
-    ++line;
+    ++state.line;
 }
 
-std::optional<AssemblerDirective> process_line(std::string_view input, unsigned& line, std::string& filename)
+// Returns true if the line was an instruction, which then went into 'ins'
+bool process_line(std::string_view input, ParserState& state, std::vector<std::string_view>& tokens, Instruction& ins)
 {
-    auto tokens = split(input, " ,");
+    split(input, tokens, " ,");
     if (tokens.empty())
     {
-        ++line;
-        return {};
+        ++state.line;
+        return false;
     }
 
     if (tokens[0] == "#line")
     {
-        handle_line_directive(tokens, line, filename);
-        return {};
+        handle_line_directive(tokens, state);
+        return false;
     }
     else if (tokens.size() == 1 && trim(tokens[0]).back() == ':')
     {
-        handle_lone_label(tokens, line, filename);
-        return {};
+        handle_lone_label(tokens, state);
+        return false;
     }
     else
     {
-        return handle_instruction(tokens, line, filename);
+        handle_instruction(tokens, state, ins);
+        return true;
     }
 }
 
-std::vector<AssemblerDirective> parse(std::string_view input, std::string_view filename)
+size_t parse(std::string_view input, std::string_view filename, ParseScratch& scratch)
 {
-    std::vector<AssemblerDirective> directives;
-    unsigned line_number { 1 };
-    std::string current_filename { filename };
+    auto& pool = scratch.directives;
+    size_t count { 0 };
+    ParserState state;
+    state.filename = filename;
+
+    split(input, scratch.lines, "\n", false, false);
+
+    for (auto line : scratch.lines)
+    {
+        if (count == pool.size()) pool.emplace_back(Instruction{});
+
+        line = trim(line);
+        if (process_line(line, state, scratch.tokens, std::get<Instruction>(pool[count]))) ++count;
+    }
+
+    return count;
+}
 
-    auto lines = split(input, "\n", false, false);
+IncrementalParser::IncrementalParser(std::string_view filename)
+{
+    state.filename = filename;
+}
+
+void IncrementalParser::parse(std::string_view chunk, std::vector<AssemblerDirective>& directives)
+{
+    // A quote runs over line ends, the lines it spans are parsed once it is closed
+    const bool odd_quotes = std::count(chunk.begin(), chunk.end(), '"') % 2;
+    if (pending.empty() && !odd_quotes)
+    {
+        parse_lines(chunk, directives);
+        return;
+    }
+
+    pending += chunk;
+    open_quote ^= odd_quotes;
+    if (!open_quote)
+    {
+        parse_lines(pending, directives);
+        pending.clear();
+    }
+}
+
+void IncrementalParser::parse(gsl::span<const PreprocessedLine> lines, std::vector<AssemblerDirective>& directives)
+{
+    for (const auto& line : lines)
+    {
+        state.line = line.line;
+        if (state.filename != line.filename) state.filename = line.filename;
+
+        if (process_line(trim(line.text), state, tokens, ins)) directives.emplace_back(std::move(ins));
+    }
+}
+
+void IncrementalParser::finish(std::vector<AssemblerDirective>& directives)
+{
+    if (!pending.empty())
+    {
+        parse_lines(pending, directives);
+        pending.clear();
+    }
+}
+
+void IncrementalParser::parse_lines(std::string_view input, std::vector<AssemblerDirective>& directives)
+{
+    split(input, lines, "\n", false, false);
 
     for (auto line : lines)
     {
         line = trim(line);
-        auto dir = process_line(line, line_number, current_filename);
-        if (dir) directives.emplace_back(dir.value());
+        if (process_line(line, state, tokens, ins)) directives.emplace_back(std::move(ins));
     }
+}
 
-    return directives;
+std::vector<AssemblerDirective> parse(std::string_view input, std::string_view filename)
+{
+    ParseScratch scratch;
+    scratch.directives.resize(parse(input, filename, scratch));
+    return std::move(scratch.directives);
 }
 
 }
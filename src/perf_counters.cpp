@@ -0,0 +1,237 @@
+/*
+perf_counters.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+namespace floaty
+{
+
+namespace
+{
+
+#ifdef __linux__
+
+struct EventDef
+{
+    uint32_t type;
+    uint64_t config;
+};
+
+constexpr std::array<EventDef, (size_t)HardwareEvent::Count> event_defs
+{{
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                         (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+}};
+
+// The events of one thread, opened as a single group so that one read() returns all of them
+class ThreadCounters
+{
+public:
+    ThreadCounters()
+    {
+        for (size_t i { 0 }; i < event_defs.size(); ++i)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = event_defs[i].type;
+            attr.config = event_defs[i].config;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            // user space only, which perf_event_paranoid 2 still allows
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.disabled = leader < 0;
+
+            int fd = (int)::syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fd < 0)
+            {
+                if (open_errno == 0) open_errno = errno;
+                continue;
+            }
+            if (leader < 0) leader = fd;
+            fds[i] = fd;
+            slots[i] = event_count++;
+        }
+
+        if (leader >= 0)
+        {
+            ::ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ::ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+    }
+
+    ~ThreadCounters()
+    {
+        for (int fd : fds)
+        {
+            if (fd >= 0) ::close(fd);
+        }
+    }
+
+    ThreadCounters(const ThreadCounters&) = delete;
+    ThreadCounters& operator=(const ThreadCounters&) = delete;
+
+    HardwareCounts read() const
+    {
+        HardwareCounts counts { };
+        if (leader < 0) return counts;
+
+        // nr, time_enabled, time_running, then one value per event in the order they were opened
+        uint64_t buffer[3 + (size_t)HardwareEvent::Count];
+        if (::read(leader, buffer, sizeof(buffer)) < ssize_t((3 + event_count) * sizeof(uint64_t))) return counts;
+
+        const uint64_t enabled = buffer[1];
+        const uint64_t running = buffer[2];
+        for (size_t i { 0 }; i < counts.size(); ++i)
+        {
+            if (fds[i] < 0) continue;
+            uint64_t value = buffer[3 + slots[i]];
+            if (running != 0 && running < enabled)
+            {
+                value = uint64_t(double(value) * enabled / running);
+            }
+            counts[i] = value;
+        }
+        return counts;
+    }
+
+    bool supported(HardwareEvent event) const
+    {
+        return fds[(size_t)event] >= 0;
+    }
+
+    bool any() const
+    {
+        return leader >= 0;
+    }
+
+    int error() const
+    {
+        return open_errno;
+    }
+
+private:
+    std::array<int, (size_t)HardwareEvent::Count> fds { -1, -1, -1, -1 };
+    std::array<size_t, (size_t)HardwareEvent::Count> slots { };
+    size_t event_count { 0 };
+    int leader { -1 };
+    int open_errno { 0 };
+};
+
+ThreadCounters& thread_counters()
+{
+    thread_local ThreadCounters counters;
+    return counters;
+}
+
+#endif
+
+}
+
+const char *hardware_event_name(HardwareEvent event)
+{
+    switch (event)
+    {
+        case HardwareEvent::Cycles: return "cycles";
+        case HardwareEvent::Instructions: return "instructions";
+        case HardwareEvent::BranchMisses: return "branch_misses";
+        case HardwareEvent::CacheMisses: return "llc_misses";
+        case HardwareEvent::Count: break;
+    }
+    __builtin_unreachable();
+}
+
+#ifdef __linux__
+
+HardwareCounts thread_hardware_counts()
+{
+    return thread_counters().read();
+}
+
+bool hardware_counters_available(std::string &reason)
+{
+    const auto& counters = thread_counters();
+    if (counters.any()) return true;
+
+    switch (counters.error())
+    {
+        case EACCES:
+        case EPERM:
+            reason = "access denied, check /proc/sys/kernel/perf_event_paranoid";
+            break;
+        case ENOENT:
+        case ENODEV:
+        case EOPNOTSUPP:
+            reason = "no hardware counters on this machine";
+            break;
+        case ENOSYS:
+            reason = "perf_event_open is not available";
+            break;
+        default:
+            reason = std::strerror(counters.error());
+            break;
+    }
+    return false;
+}
+
+bool hardware_event_supported(HardwareEvent event)
+{
+    return thread_counters().supported(event);
+}
+
+#else
+
+HardwareCounts thread_hardware_counts()
+{
+    return {};
+}
+
+bool hardware_counters_available(std::string &reason)
+{
+    reason = "hardware counters are only supported on Linux";
+    return false;
+}
+
+bool hardware_event_supported(HardwareEvent)
+{
+    return false;
+}
+
+#endif
+
+}
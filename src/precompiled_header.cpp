@@ -0,0 +1,308 @@
+/*
+precompiled_header.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "precompiled_header.hpp"
+
+#include <cstring>
+
+#include <filesystem>
+
+#include <boost/wave/wave_version.hpp>
+
+#include "build_cache.hpp"
+#include "hasher.hpp"
+#include "source_file.hpp"
+
+namespace floaty
+{
+
+namespace
+{
+
+constexpr char file_magic[4] = { 'F', 'P', 'H', '1' };
+// the token ids are Wave's
+const std::string format_version = "wave-" + std::to_string(BOOST_WAVE_VERSION);
+
+class Writer
+{
+public:
+    void u32(uint32_t value)
+    {
+        data.append((const char*)&value, sizeof(value));
+    }
+
+    void string(std::string_view str)
+    {
+        u32(str.size());
+        data.append(str);
+    }
+
+    void token(const PrecompiledToken& token)
+    {
+        u32(token.id);
+        string(token.value);
+        u32(token.file);
+        u32(token.line);
+        u32(token.column);
+    }
+
+    void tokens(const std::vector<PrecompiledToken>& tokens)
+    {
+        u32(tokens.size());
+        for (const auto& token : tokens)
+        {
+            this->token(token);
+        }
+    }
+
+    std::string data;
+};
+
+class Reader
+{
+public:
+    Reader(std::string_view data, const std::string& path)
+        : data(data), path(path)
+    {}
+
+    uint32_t u32()
+    {
+        uint32_t value;
+        std::memcpy(&value, take(sizeof(value)).data(), sizeof(value));
+        return value;
+    }
+
+    std::string string()
+    {
+        return std::string(take(u32()));
+    }
+
+    // a count of items of at least 'min_size' bytes each, checked against what is left
+    uint32_t count(size_t min_size)
+    {
+        const uint32_t count = u32();
+        if (uint64_t(count) * min_size > data.size() - offset)
+        {
+            malformed();
+        }
+        return count;
+    }
+
+    PrecompiledToken token(size_t filename_count)
+    {
+        PrecompiledToken token;
+        token.id = u32();
+        token.value = string();
+        token.file = u32();
+        token.line = u32();
+        token.column = u32();
+        if (token.file >= filename_count)
+        {
+            malformed();
+        }
+        return token;
+    }
+
+    std::vector<PrecompiledToken> tokens(size_t filename_count)
+    {
+        std::vector<PrecompiledToken> tokens(count(token_min_size));
+        for (auto& token : tokens)
+        {
+            token = this->token(filename_count);
+        }
+        return tokens;
+    }
+
+    bool at_end() const
+    {
+        return offset == data.size();
+    }
+
+    [[noreturn]] void malformed() const
+    {
+        io_error_throw("Malformed precompiled header", path);
+    }
+
+    static constexpr size_t token_min_size { 5 * sizeof(uint32_t) };
+
+private:
+    std::string_view take(size_t size)
+    {
+        if (size > data.size() - offset)
+        {
+            malformed();
+        }
+        offset += size;
+        return data.substr(offset - size, size);
+    }
+
+    std::string_view data;
+    size_t offset { 0 };
+    const std::string& path;
+};
+
+}
+
+std::string source_digest(std::string_view contents)
+{
+    Hasher hasher;
+    hasher.add(contents);
+    return hasher.hex_digest();
+}
+
+std::string precompiled_header_digest(const PrecompiledHeader &header)
+{
+    Hasher hasher;
+    hasher.add("pch-1 " + format_version);
+    hasher.add(header.header);
+    hasher.add(std::to_string(header.defines.size()));
+    for (const auto& define : header.defines)
+    {
+        hasher.add(define);
+    }
+    hasher.add(std::to_string(header.sources.size()));
+    for (const auto& source : header.sources)
+    {
+        hasher.add(source.filename);
+        hasher.add(source.digest);
+    }
+    return hasher.hex_digest();
+}
+
+void save_precompiled_header(const PrecompiledHeader &header, const std::string &path)
+{
+    Writer writer;
+    writer.data.append(file_magic, sizeof(file_magic));
+    writer.string(format_version);
+    writer.string(header.header);
+    writer.string(header.digest);
+
+    writer.u32(header.defines.size());
+    for (const auto& define : header.defines)
+    {
+        writer.string(define);
+    }
+    writer.u32(header.sources.size());
+    for (const auto& source : header.sources)
+    {
+        writer.string(source.filename);
+        writer.string(source.digest);
+    }
+    writer.u32(header.filenames.size());
+    for (const auto& filename : header.filenames)
+    {
+        writer.string(filename);
+    }
+    writer.u32(header.macros.size());
+    for (const auto& macro : header.macros)
+    {
+        writer.token(macro.name);
+        writer.u32(macro.function_like);
+        writer.tokens(macro.parameters);
+        writer.tokens(macro.definition);
+    }
+    writer.u32(header.guarded_files.size());
+    for (const auto& file : header.guarded_files)
+    {
+        writer.string(file.filename);
+        writer.string(file.guard);
+    }
+
+    // a build reading the file while it is rewritten sees either version
+    auto directory = std::filesystem::path(path).parent_path().string();
+    write_file_atomically(path, directory.empty() ? "." : directory,
+                          gsl::span<const uint8_t>((const uint8_t*)writer.data.data(), writer.data.size()));
+}
+
+PrecompiledHeader load_precompiled_header(const std::string &path)
+{
+    SourceFile file(path);
+    const auto contents = file.view();
+    if (contents.size() < sizeof(file_magic) || std::memcmp(contents.data(), file_magic, sizeof(file_magic)) != 0)
+    {
+        io_error_throw("Not a precompiled header", path);
+    }
+
+    Reader reader(contents.substr(sizeof(file_magic)), path);
+    if (reader.string() != format_version)
+    {
+        io_error_throw("Precompiled header built by another version of the assembler", path);
+    }
+
+    PrecompiledHeader header;
+    header.header = reader.string();
+    header.digest = reader.string();
+
+    header.defines.resize(reader.count(sizeof(uint32_t)));
+    for (auto& define : header.defines)
+    {
+        define = reader.string();
+    }
+    header.sources.resize(reader.count(2 * sizeof(uint32_t)));
+    for (auto& source : header.sources)
+    {
+        source.filename = reader.string();
+        source.digest = reader.string();
+    }
+    header.filenames.resize(reader.count(sizeof(uint32_t)));
+    for (auto& filename : header.filenames)
+    {
+        filename = reader.string();
+    }
+    header.macros.resize(reader.count(Reader::token_min_size + 3 * sizeof(uint32_t)));
+    for (auto& macro : header.macros)
+    {
+        macro.name = reader.token(header.filenames.size());
+        macro.function_like = reader.u32() != 0;
+        macro.parameters = reader.tokens(header.filenames.size());
+        macro.definition = reader.tokens(header.filenames.size());
+    }
+    header.guarded_files.resize(reader.count(2 * sizeof(uint32_t)));
+    for (auto& file : header.guarded_files)
+    {
+        file.filename = reader.string();
+        file.guard = reader.string();
+    }
+
+    if (!reader.at_end() || header.digest != precompiled_header_digest(header))
+    {
+        reader.malformed();
+    }
+
+    return header;
+}
+
+void check_precompiled_header(const PrecompiledHeader &header)
+{
+    for (const auto& source : header.sources)
+    {
+        if (source_digest(SourceFile(source.filename).view()) != source.digest)
+        {
+            io_error_throw("Precompiled header of " + header.header + " is out of date, rebuild it", source.filename);
+        }
+    }
+}
+
+}
@@ -29,33 +29,859 @@ SOFTWARE.
 
 #include <boost/wave/cpplexer/cpp_lex_token.hpp>    // token class
 #include <boost/wave/cpplexer/cpp_lex_iterator.hpp> // lexer class
+#include <boost/wave/cpplexer/detect_include_guards.hpp>
 
-#include <boost/algorithm/string/replace.hpp>
+#include <algorithm>
+#include <cctype>
+#include <unordered_map>
+
+#include "char_scan.hpp"
+#include "source_file.hpp"
+#include "token_cache.hpp"
+#include "profiler.hpp"
+#include "trace.hpp"
 
 namespace floaty
 {
 
-std::string preprocess(std::string_view input, std::string_view filename)
+//  This token type is one of the central types used throughout the library.
+//  It is a template parameter to some of the public classes and instances
+//  of this type are returned from the iterators.
+typedef boost::wave::cpplexer::lex_token<> token_type;
+typedef token_type::position_type position_type;
+
+//  The template boost::wave::cpplexer::lex_iterator<> is the lexer type to
+//  to use as the token source for the preprocessing engine. It is
+//  parametrized with the token type.
+typedef boost::wave::cpplexer::lex_iterator<token_type> lex_iterator_type;
+
+typedef boost::wave::cpplexer::lex_input_interface<token_type> lex_input_type;
+
+// A lexer iterator over another lexer than Wave's own, such as ReplayLexer, which it takes ownership of. Wave's
+// grammars are only built for lex_iterator, so its multi_pass base is set instead of deriving a new iterator type.
+lex_iterator_type make_lex_iterator(lex_input_type* lexer)
+{
+    typedef boost::wave::cpplexer::make_multi_pass<
+                boost::wave::cpplexer::impl::lex_iterator_functor_shim<token_type>> multi_pass;
+
+    lex_iterator_type iterator;
+    static_cast<multi_pass::type&>(iterator) = multi_pass::type(multi_pass::functor_data_type({}, lexer));
+    return iterator;
+}
+
+// Hands out the tokens of an included file as Wave's lexer produced them the first time
+class ReplayLexer : public lex_input_type
+{
+public:
+    ReplayLexer(std::shared_ptr<const TokenStream> stream, const position_type& pos)
+        : stream(std::move(stream)), filename(pos.get_file()), line_offset(int64_t(pos.get_line()) - 1)
+    {}
+
+    token_type& get(token_type& result) override
+    {
+        const auto tokens = stream->tokens();
+        if (next == (size_t)tokens.size())
+        {
+            return result = token_type(); // T_EOI
+        }
+
+        const auto& token = tokens[next++];
+        const auto value = stream->value(token);
+        result = token_type(boost::wave::token_id(token.id), token_type::string_type(value.data(), value.size()),
+                            position_type(filename, token.line + line_offset, token.column));
+
+#if BOOST_WAVE_SUPPORT_PRAGMA_ONCE != 0
+        return guards.detect_guard(result);
+#else
+        return result;
+#endif
+    }
+
+    // Same as Wave's lexer : only the file name and the line numbers of the next tokens change
+    void set_position(const position_type& pos) override
+    {
+        filename = pos.get_file();
+        if (next < (size_t)stream->tokens().size())
+        {
+            line_offset = int64_t(pos.get_line()) - stream->tokens()[next].line;
+        }
+    }
+
+#if BOOST_WAVE_SUPPORT_PRAGMA_ONCE != 0
+    bool has_include_guards(std::string& guard_name) const override
+    {
+        return guards.detected(guard_name);
+    }
+#endif
+
+private:
+    std::shared_ptr<const TokenStream> stream;
+    size_t next { 0 };
+    position_type::string_type filename;
+    int64_t line_offset;
+#if BOOST_WAVE_SUPPORT_PRAGMA_ONCE != 0
+    boost::wave::cpplexer::include_guards<token_type> guards;
+#endif
+};
+
+// Runs Wave's lexer over an included file and stores its tokens in the cache once it reached the end. Nothing is
+// stored if a lexing error or a #line directive got in the way.
+class RecordingLexer : public lex_input_type
+{
+public:
+    RecordingLexer(lex_input_type* lexer, TokenCache& cache, std::string key)
+        : lexer(lexer), cache(cache), key(std::move(key))
+    {}
+
+    token_type& get(token_type& result) override
+    {
+        try
+        {
+            lexer->get(result);
+        }
+        catch (...)
+        {
+            recording = false;
+            throw;
+        }
+        if (!recording)
+        {
+            return result;
+        }
+
+        if (boost::wave::token_id(result) == boost::wave::T_EOI)
+        {
+            cache.store(key, tokens, values);
+            recording = false;
+            return result;
+        }
+
+        const auto& value = result.get_value();
+        const auto& pos = result.get_position();
+        tokens.push_back({uint32_t(boost::wave::token_id(result)), uint32_t(pos.get_line()), uint32_t(pos.get_column()),
+                          uint32_t(values.size()), uint32_t(value.size())});
+        values.append(value.data(), value.size());
+        return result;
+    }
+
+    void set_position(const position_type& pos) override
+    {
+        lexer->set_position(pos);
+        recording = false;
+    }
+
+#if BOOST_WAVE_SUPPORT_PRAGMA_ONCE != 0
+    bool has_include_guards(std::string& guard_name) const override
+    {
+        return lexer->has_include_guards(guard_name);
+    }
+#endif
+
+private:
+    std::unique_ptr<lex_input_type> lexer;
+    TokenCache& cache;
+    std::string key;
+    bool recording { true };
+    std::vector<CachedToken> tokens;
+    std::string values;
+};
+
+// Same whitespace handling as the default context, plus access to the include loader
+struct preprocessing_hooks : boost::wave::context_policies::eat_whitespace<token_type>
+{
+    struct OpenFile
+    {
+        std::string filename;
+        // when the include started, only while tracing
+        uint64_t trace_start;
+    };
+
+    template <typename ContextT>
+    bool locate_include_file(ContextT& ctx, std::string& file_path, bool is_system, char const* current_name,
+                             std::string& dir_path, std::string& native_name)
+    {
+        const auto& includer = open_files.empty() ? main_filename : open_files.back().filename;
+        if (!loader->locate(file_path, includer, native_name))
+        {
+            return eat_whitespace::locate_include_file(ctx, file_path, is_system, current_name, dir_path, native_name);
+        }
+
+        auto separator = native_name.rfind('/');
+        dir_path = separator == std::string::npos ? std::string{} : native_name.substr(0, separator);
+        return true;
+    }
+
+    template <typename ContextT>
+    void returning_from_include_file(ContextT const&)
+    {
+        if (open_files.empty()) return;
+
+        if (tracer) tracer->complete("include", std::move(open_files.back().filename), open_files.back().trace_start);
+        open_files.pop_back();
+    }
+
+    // Replaces the #line directive Wave would write with a bare T_PP_LINE token positioned at the line that follows,
+    // so that the position doesn't have to be read back from text
+    template <typename ContextT, typename ContainerT>
+    bool emit_line_directive(ContextT const& ctx, ContainerT& pending, typename ContextT::token_type const&)
+    {
+        typedef typename ContainerT::value_type result_type;
+
+        // Wave already moved its position back a line to account for the directive's newline
+        auto pos = ctx.get_main_pos();
+        pos.set_line(pos.get_line() + 1);
+        pending.push_back(result_type(boost::wave::T_PP_LINE, "#line", pos));
+        pending.push_back(result_type(boost::wave::T_GENERATEDNEWLINE, "\n", pos));
+        return true;
+    }
+
+    template <typename ContextT>
+    void detected_include_guard(ContextT const&, std::string const& filename, std::string const& include_guard)
+    {
+        if (guarded_files) guarded_files->push_back({filename, include_guard});
+    }
+
+    template <typename ContextT, typename TokenT>
+    void detected_pragma_once(ContextT const&, TokenT const&, std::string const& filename)
+    {
+        // the guard name Wave gives to these
+        if (guarded_files) guarded_files->push_back({filename, "__BOOST_WAVE_PRAGMA_ONCE__"});
+    }
+
+    IncludeLoader* loader { nullptr };
+    std::vector<IncludedFile>* included_files { nullptr };
+    TokenCache* token_cache { nullptr };
+    // filled while precompiling a header
+    std::vector<GuardedFile>* guarded_files { nullptr };
+    std::string main_filename;
+
+    // include files being processed, innermost last
+    std::vector<OpenFile> open_files;
+    TraceWriter* tracer { nullptr };
+};
+
+// Input policy for included files, goes through the IncludeLoader instead of reading the file itself
+struct load_through_loader
+{
+    template <typename IterContextT>
+    class inner
+    {
+    public:
+        template <typename PositionT>
+        static void init_iterators(IterContextT &iter_ctx,
+                                   PositionT const &act_pos, boost::wave::language_support language)
+        {
+            typedef typename IterContextT::iterator_type iterator_type;
+
+            auto& hooks = iter_ctx.ctx.get_hooks();
+            // popped by returning_from_include_file(), so that the trace span covers loading the file too
+            hooks.open_files.push_back({iter_ctx.filename.c_str(), hooks.tracer ? hooks.tracer->now() : 0});
+            iter_ctx.contents = hooks.loader->load(iter_ctx.filename.c_str());
+            if (!iter_ctx.contents)
+            {
+                BOOST_WAVE_THROW_CTX(iter_ctx.ctx, boost::wave::preprocess_exception,
+                                     bad_include_file, iter_ctx.filename.c_str(), act_pos);
+                return;
+            }
+            if (hooks.included_files)
+            {
+                hooks.included_files->push_back({iter_ctx.filename.c_str(), iter_ctx.contents});
+            }
+
+            if (hooks.token_cache)
+            {
+                // the tokens only depend on the contents and the language, the position is the file's own
+                auto key = TokenCache::key(*iter_ctx.contents, language);
+                if (auto stream = hooks.token_cache->lookup(key))
+                {
+                    iter_ctx.first = make_lex_iterator(new ReplayLexer(std::move(stream),
+                                                                       PositionT(iter_ctx.filename)));
+                }
+                else
+                {
+                    auto lexer = boost::wave::cpplexer::lex_input_interface_generator<token_type>::new_lexer(
+                                iter_ctx.contents->begin(), iter_ctx.contents->end(), PositionT(iter_ctx.filename),
+                                language);
+                    iter_ctx.first = make_lex_iterator(new RecordingLexer(lexer, *hooks.token_cache, std::move(key)));
+                }
+            }
+            else
+            {
+                iter_ctx.first = iterator_type(iter_ctx.contents->begin(), iter_ctx.contents->end(),
+                                               PositionT(iter_ctx.filename), language);
+            }
+            iter_ctx.last = iterator_type();
+        }
+
+    private:
+        std::shared_ptr<const std::string> contents;
+    };
+};
+
+std::shared_ptr<const std::string> IncludeLoader::load(const std::string &filename)
 {
-    boost::wave::util::file_position_type current_position;
     try
     {
-        //  This token type is one of the central types used throughout the library.
-        //  It is a template parameter to some of the public classes and instances
-        //  of this type are returned from the iterators.
-        typedef boost::wave::cpplexer::lex_token<> token_type;
+        ScopedPhase phase(Phase::Read);
+        SourceFile file(filename);
+        phase.add_items(file.view().size());
+        return std::make_shared<const std::string>(file.view());
+    }
+    catch (const io_error&)
+    {
+        return nullptr;
+    }
+}
+
+std::string preprocess(std::string_view input, std::string_view filename, const PreprocessOptions& options)
+{
+    std::string processed;
+    preprocess(input, filename, options, processed);
+    return processed;
+}
+
+namespace
+{
+
+bool is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+}
+
+bool is_identifier_char(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+// Returns false when Wave would only strip the comments of 'input' and squeeze its whitespace, which
+// strip_comments() does without building a context : no directive, no macro, and none of what the lexer rewrites
+// (trigraphs, digraphs, line continuations, block comments, pp-numbers it splits, e.g. "12ab" into "12 ab") or
+// spaces out (runs of operators such as "+++" or "-==", "^^", '?'). Unsure cases go to Wave.
+// The ';' comments of options.comments are skipped, as if they had been removed.
+bool needs_wave(std::string_view input, const PreprocessOptions& options)
+{
+    // Wave rejects a last line without a newline
+    if (!options.defines.empty() || options.prelude || (!input.empty() && input.back() != '\n')) return true;
+
+    auto next_comment = options.comments.begin();
+    bool in_string { false };
+    size_t operator_run { 0 };
+    for (size_t i { 0 }; i < input.size(); ++i)
+    {
+        if (next_comment != options.comments.end() && i == *next_comment)
+        {
+            // on to its newline, the input ends with one
+            i = input.find('\n', i) - 1;
+            ++next_comment;
+            continue;
+        }
+
+        const unsigned char c = input[i];
+        const char next = i + 1 < input.size() ? input[i + 1] : '\0';
+
+        if (c == '?' && next == '?') return true;
+        if (c == '\\') return true;
+        if (c == '\r' && next != '\n') return true;
+        if (c < ' ' && !is_blank(c) && c != '\r' && c != '\n') return true;
+
+        if (in_string)
+        {
+            if (c == '"') in_string = false;
+            else if (c == '\n') return true;
+            continue;
+        }
+
+        if (std::string_view("+-*/%<>=!&|^~.").find(c) != std::string_view::npos)
+        {
+            if (++operator_run == 3) return true;
+        }
+        else
+        {
+            operator_run = 0;
+        }
+
+        switch (c)
+        {
+            case '"':
+                // raw string literals can span lines and hold quotes
+                if (i > 0 && input[i - 1] == 'R') return true;
+                in_string = true;
+                break;
+            case '/':
+                if (next == '*') return true;
+                if (next == '/')
+                {
+                    // comment contents only matter to the checks above
+                    while (input[i + 1] != '\n')
+                    {
+                        ++i;
+                        const unsigned char comment_c = input[i];
+                        if (comment_c == '\\' || (comment_c == '?' && input[i + 1] == '?')) return true;
+                        if (comment_c == '\r' && input[i + 1] != '\n') return true;
+                        if (comment_c < ' ' && !is_blank(comment_c) && comment_c != '\r') return true;
+                    }
+                }
+                break;
+            case '#': case '\'': case '$': case '@': case '`': case '?':
+                return true;
+            case '^':
+                if (next == '^') return true;
+                break;
+            case '%':
+                if (next == ':') return true;
+                break;
+            case '.':
+                if (isdigit((unsigned char)next)) return true;
+                break;
+            case '_':
+                // predefined macros all start with "__"
+                if (next == '_' || input.substr(i, 7) == "_Pragma") return true;
+                break;
+            default:
+                if (c >= 0x80) return true;
+                if (isdigit(c) && (i == 0 || !is_identifier_char(input[i - 1])))
+                {
+                    // only plain decimal and hexadecimal numbers
+                    size_t end = i;
+                    if (c == '0' && (next == 'x' || next == 'X'))
+                    {
+                        end += 2;
+                        if (!isxdigit((unsigned char)input[end])) return true;
+                        while (isxdigit((unsigned char)input[end])) ++end;
+                    }
+                    else
+                    {
+                        while (isdigit((unsigned char)input[end])) ++end;
+                    }
+                    if (is_identifier_char(input[end]) || input[end] == '.') return true;
+                    i = end - 1;
+                }
+                break;
+        }
+    }
+
+    return false;
+}
+
+// What Wave outputs for an 'input' that needs_wave() let through : every line without its comment, leading
+// whitespace and runs of more than one blank (single ones are kept as-is). Blank lines are skipped, the next line
+// gets the newline or position Wave would emit, so that parse() sees the same line numbers and files.
+// The ';' comments in 'comments' end their line as '//' ones do.
+template <typename Output>
+void strip_comments(std::string_view input, gsl::span<const size_t> comments, std::string_view filename,
+                    Output& output)
+{
+    auto next_comment = comments.begin();
+    std::string line;
+    std::string complete_filename;
+    size_t line_number { 0 };
+    size_t previous_line { 0 };
+    // until its first #line directive, Wave lags a line behind and never prefers a newline
+    bool synced { false };
+
+    size_t begin { 0 };
+    while (begin < input.size())
+    {
+        const size_t end = input.find('\n', begin);
+        ++line_number;
+
+        line.clear();
+        size_t blanks { 0 };
+        size_t i { begin };
+        for (; i < end; ++i)
+        {
+            const char c = input[i];
+            if (is_blank(c))
+            {
+                ++blanks;
+                continue;
+            }
+            if ((c == '/' && input[i + 1] == '/') || c == '\r') break;
+            if (next_comment != comments.end() && i == *next_comment) break;
+
+            if (blanks && !line.empty()) line += blanks == 1 ? input[i - 1] : ' ';
+            blanks = 0;
+
+            if (c == '"')
+            {
+                const size_t closing = input.find('"', i + 1);
+                line.append(input.data() + i, closing + 1 - i);
+                i = closing;
+            }
+            else
+            {
+                line += c;
+            }
+        }
+        if (blanks && !line.empty()) line += blanks == 1 ? input[i - 1] : ' ';
+        begin = end + 1;
+        while (next_comment != comments.end() && *next_comment < begin) ++next_comment;
+
+        if (line.empty()) continue;
 
-        //  The template boost::wave::cpplexer::lex_iterator<> is the lexer type to
-        //  to use as the token source for the preprocessing engine. It is
-        //  parametrized with the token type.
-        typedef boost::wave::cpplexer::lex_iterator<token_type> lex_iterator_type;
+        if (line_number != previous_line + 1)
+        {
+            if (!synced || line_number != previous_line + 2)
+            {
+                if (complete_filename.empty())
+                {
+                    complete_filename = filename;
+                    if (complete_filename != "<Unknown>" && complete_filename != "<stdin>")
+                    {
+                        const boost::filesystem::path path(complete_filename);
+                        complete_filename = boost::wave::util::complete_path(path).string();
+                    }
+                }
+                output.position(complete_filename, line_number);
+                synced = true;
+            }
+            output.text("\n");
+        }
+        previous_line = line_number;
 
+        line += '\n';
+        output.text(line);
+    }
+}
+
+// What Wave writes for a position, without the newline
+std::string line_directive(std::string_view filename, unsigned line)
+{
+    return "#line " + std::to_string(line) + " \"" + boost::wave::util::impl::escape_lit(std::string(filename)) + "\"";
+}
+
+// Writes the preprocessed text out, with the positions as #line directives
+template <typename Append>
+struct TextOutput
+{
+    void text(std::string_view piece)
+    {
+        append(piece);
+    }
+    // the newline follows as text
+    void position(std::string_view filename, unsigned line)
+    {
+        append(line_directive(filename, line));
+    }
+
+    Append append;
+};
+
+template <typename Append>
+TextOutput<Append> text_output(Append&& append)
+{
+    return {std::forward<Append>(append)};
+}
+
+// Cuts the preprocessed output into lines and hands them over in batches, each with its position. Like parse(), a
+// quote runs over line ends : the lines it spans are handed over as one, positioned at its first line.
+class LineBatcher
+{
+public:
+    LineBatcher(std::string_view filename, size_t batch_size,
+                const std::function<void(gsl::span<const PreprocessedLine>)>& consumer)
+        : batch_size(batch_size), consumer(consumer)
+    {
+        filenames.emplace_back(filename);
+    }
+
+    void text(std::string_view piece)
+    {
+        for (size_t special; (special = piece.find_first_of("\"\n")) != std::string_view::npos; )
+        {
+            contents.append(piece.data(), special);
+            if (piece[special] == '"')
+            {
+                contents += '"';
+                open_quote = !open_quote;
+            }
+            else if (open_quote)
+            {
+                contents += '\n';
+            }
+            else
+            {
+                end_line();
+            }
+            piece.remove_prefix(special + 1);
+        }
+        contents += piece;
+    }
+
+    // Like a #line directive : the line holding it doesn't count, the next one is 'line' of 'filename'
+    void position(std::string_view filename, unsigned line)
+    {
+        if (open_quote)
+        {
+            // parse() would take the directive as part of the quote
+            contents += line_directive(filename, line);
+            return;
+        }
+
+        if (filename != filenames.back()) filenames.emplace_back(filename);
+        next_line = line;
+        positioned = true;
+    }
+
+    void finish()
+    {
+        if (contents.size() != line_start) end_line();
+        flush();
+    }
+
+private:
+    struct Line
+    {
+        size_t begin;
+        size_t end;
+        size_t filename;
+        unsigned line;
+    };
+
+    void end_line()
+    {
+        if (contents.size() != line_start)
+        {
+            lines.push_back({line_start, contents.size(), filenames.size() - 1, line});
+        }
+        line = positioned ? next_line : line + 1;
+        positioned = false;
+        line_start = contents.size();
+
+        if (contents.size() >= batch_size) flush();
+    }
+
+    void flush()
+    {
+        if (lines.empty()) return;
+
+        batch.clear();
+        for (const auto& line : lines)
+        {
+            batch.push_back({std::string_view(contents).substr(line.begin, line.end - line.begin),
+                             filenames[line.filename], line.line});
+        }
+        consumer(batch);
+
+        // only called between lines, nothing is left over
+        lines.clear();
+        contents.clear();
+        line_start = 0;
+        filenames.erase(filenames.begin(), filenames.end() - 1);
+    }
+
+    size_t batch_size;
+    const std::function<void(gsl::span<const PreprocessedLine>)>& consumer;
+
+    // the lines of the batch, then the current one
+    std::string contents;
+    size_t line_start { 0 };
+    std::vector<Line> lines;
+    // those of the batch, the current one last
+    std::vector<std::string> filenames;
+    unsigned line { 1 };
+    bool open_quote { false };
+    // set by a position until the end of its line
+    bool positioned { false };
+    unsigned next_line { 0 };
+    std::vector<PreprocessedLine> batch;
+};
+
+// Output of a header being precompiled, remembers where the first text that isn't blank is
+struct BlankOutput
+{
+    void text(std::string_view piece)
+    {
+        if (!stray.empty()) return;
+
+        for (char c : piece)
+        {
+            if (c == '\n') ++line;
+            else if (!is_blank(c) && c != '\r')
+            {
+                stray = piece;
+                return;
+            }
+        }
+    }
+
+    void position(std::string_view filename, unsigned line)
+    {
+        file = filename;
+        // the newline of the directive follows
+        this->line = line - 1;
+    }
+
+    std::string file;
+    unsigned line { 1 };
+    std::string stray;
+};
+
+// Adds the macros and guarded files of 'header' to a context that has no macro of its own yet
+template <typename ContextT>
+void load_prelude(ContextT& ctx, const PrecompiledHeader& header)
+{
+    typedef typename ContextT::token_type token_type;
+    typedef typename token_type::string_type string_type;
+
+    std::vector<string_type> filenames;
+    filenames.reserve(header.filenames.size());
+    for (const auto& filename : header.filenames)
+    {
+        filenames.emplace_back(filename.c_str());
+    }
+
+    const auto to_token = [&filenames](const PrecompiledToken& token)
+    {
+        return token_type(boost::wave::token_id(token.id), string_type(token.value.c_str(), token.value.size()),
+                          position_type(filenames[token.file], token.line, token.column));
+    };
+
+    std::vector<token_type> parameters;
+    typename ContextT::token_sequence_type definition;
+    for (const auto& macro : header.macros)
+    {
+        parameters.clear();
+        definition.clear();
+        for (const auto& token : macro.parameters) parameters.push_back(to_token(token));
+        for (const auto& token : macro.definition) definition.push_back(to_token(token));
+
+        ctx.add_macro_definition(to_token(macro.name), macro.function_like, parameters, definition);
+    }
+
+    for (const auto& file : header.guarded_files)
+    {
+        ctx.add_pragma_once_header(file.filename, file.guard);
+    }
+}
+
+// Stores the macros defined in 'ctx', apart from the predefined ones, into 'header'
+template <typename ContextT>
+void save_macros(const ContextT& ctx, PrecompiledHeader& header)
+{
+    typedef typename ContextT::token_type token_type;
+
+    std::unordered_map<std::string, uint32_t> file_indices;
+    for (size_t i { 0 }; i < header.filenames.size(); ++i)
+    {
+        file_indices.emplace(header.filenames[i], i);
+    }
+
+    const auto to_token = [&](const token_type& token, boost::wave::token_id id)
+    {
+        const auto& pos = token.get_position();
+        auto inserted = file_indices.emplace(pos.get_file().c_str(), header.filenames.size());
+        if (inserted.second) header.filenames.emplace_back(pos.get_file().c_str());
+
+        return PrecompiledToken { uint32_t(id), std::string(token.get_value().c_str(), token.get_value().size()),
+                                  inserted.first->second, uint32_t(pos.get_line()), uint32_t(pos.get_column()) };
+    };
+
+    bool function_like { false };
+    bool is_predefined { false };
+    position_type pos;
+    std::vector<token_type> parameters;
+    typename ContextT::token_sequence_type definition;
+    for (auto it = ctx.macro_names_begin(); it != ctx.macro_names_end(); ++it)
+    {
+        if (!ctx.get_macro_definition(*it, function_like, is_predefined, pos, parameters, definition)
+            || is_predefined)
+        {
+            continue;
+        }
+
+        PrecompiledMacro macro;
+        macro.name = to_token(token_type(boost::wave::T_IDENTIFIER, *it, pos), boost::wave::T_IDENTIFIER);
+        macro.function_like = function_like;
+        for (const auto& parameter : parameters)
+        {
+            macro.parameters.push_back(to_token(parameter, boost::wave::token_id(parameter)));
+        }
+        for (const auto& token : definition)
+        {
+            auto id = boost::wave::token_id(token);
+            // Wave gives the uses of the parameters ids of their own once the macro has been expanded, the ones
+            // they were lexed with are restored so that the macro can be defined again
+            if (IS_CATEGORY(id, boost::wave::ParameterTokenType)
+                || IS_EXTCATEGORY(id, boost::wave::ExtParameterTokenType)
+                || IS_EXTCATEGORY(id, boost::wave::OptParameterTokenType))
+            {
+                auto parameter = std::find_if(parameters.begin(), parameters.end(), [&token](const token_type& p)
+                {
+                    return p.get_value() == token.get_value();
+                });
+                id = parameter != parameters.end() ? boost::wave::token_id(*parameter) : boost::wave::T_IDENTIFIER;
+            }
+            macro.definition.push_back(to_token(token, id));
+        }
+        header.macros.push_back(std::move(macro));
+    }
+}
+
+// Wave only detects the include guards of included files, the one of the header 'input' itself is looked for here
+// so that including it again after the header has been loaded is skipped as well
+template <typename ContextT>
+void save_include_guard(const ContextT& ctx, std::string_view input, std::string_view filename, PrecompiledHeader& header)
+{
+    // the name Wave gives to the main file, as in context::begin()
+    const auto complete_filename = boost::wave::util::complete_path(boost::filesystem::path(std::string(filename)))
+                                       .string();
+
+    lex_iterator_type it(input.begin(), input.end(), position_type(complete_filename.c_str()), ctx.get_language());
+    while (boost::wave::token_id(*it) != boost::wave::T_EOF)
+    {
+        ++it;
+    }
+
+    std::string guard;
+    if (it.has_include_guards(guard) && ctx.is_defined_macro(guard))
+    {
+        header.guarded_files.push_back({complete_filename, guard});
+    }
+}
+
+// Preprocesses 'input' and hands the output to 'output' piece by piece : output.text() gets the text,
+// output.position() the positions Wave writes as #line directives. With 'precompiled', the state Wave is left in
+// is saved to it.
+template <typename Output>
+void preprocess_into(std::string_view input, std::string_view filename, const PreprocessOptions& options,
+                     Output& output, PrecompiledHeader* precompiled = nullptr)
+{
+    if (!precompiled && !needs_wave(input, options))
+    {
+        strip_comments(input, options.comments, filename, output);
+        return;
+    }
+
+    // Wave reads a contiguous input
+    std::string stripped;
+    input = remove_comments(input, options.comments, stripped);
+
+    if (options.prelude && options.prelude->defines != options.defines)
+    {
+        pp_error_throw(std::string(filename) + ": the precompiled header of " + options.prelude->header
+                       + " was built with other -D options");
+    }
+
+    boost::wave::util::file_position_type current_position;
+    try
+    {
         //  This is the resulting context type. The first template parameter should
         //  match the iterator type used during construction of the context
         //  instance (see below). It is the type of the underlying input stream.
-        typedef boost::wave::context<std::string_view::iterator, lex_iterator_type>
+        typedef boost::wave::context<std::string_view::iterator, lex_iterator_type,
+                                     load_through_loader, preprocessing_hooks>
                 context_type;
 
+        static IncludeLoader default_loader;
+        preprocessing_hooks hooks;
+        hooks.loader = options.loader ? options.loader : &default_loader;
+        hooks.included_files = options.included_files;
+        hooks.token_cache = options.token_cache;
+        hooks.guarded_files = precompiled ? &precompiled->guarded_files : nullptr;
+        hooks.main_filename = filename;
+        hooks.tracer = TraceWriter::active();
+
         //  The preprocessor iterator shouldn't be constructed directly. It is
         //  generated through a wave::context<> object. This wave:context<> object
         //  is additionally used to initialize and define different parameters of
@@ -64,11 +890,24 @@ std::string preprocess(std::string_view input, std::string_view filename)
         //  The preprocessing of the input stream is done on the fly behind the
         //  scenes during iteration over the range of context_type::iterator_type
         //  instances.
-        context_type ctx (input.begin(), input.end(), filename.data());
+        context_type ctx (input.begin(), input.end(), hooks.main_filename.c_str(), hooks);
         boost::wave::language_support lang = ctx.get_language();
         //lang = boost::wave::enable_emit_line_directives(lang, false);
         ctx.set_language(lang);
 
+        if (options.prelude)
+        {
+            // its macros already include the -D ones
+            load_prelude(ctx, *options.prelude);
+        }
+        else
+        {
+            for (const auto& define : options.defines)
+            {
+                ctx.add_macro_definition(define);
+            }
+        }
+
         //  Get the preprocessor iterators and use them to generate the token
         //  sequence.
         context_type::iterator_type first = ctx.begin();
@@ -79,14 +918,25 @@ std::string preprocess(std::string_view input, std::string_view filename)
         //  information about the preprocessed input stream, such as token type,
         //  token value, and position.
 
-        std::string processed;
-
         while (first != last) {
             current_position = (*first).get_position();
-            processed += (*first).get_value().c_str();
+            // only emit_line_directive() makes those, the directives of the input are consumed by Wave
+            if (boost::wave::token_id(*first) == boost::wave::T_PP_LINE)
+            {
+                output.position(current_position.get_file().c_str(), current_position.get_line());
+            }
+            else
+            {
+                output.text(std::string_view((*first).get_value().c_str()));
+            }
             ++first;
         }
-        return processed;
+
+        if (precompiled)
+        {
+            save_macros(ctx, *precompiled);
+            save_include_guard(ctx, input, filename, *precompiled);
+        }
     }
     catch (boost::wave::cpp_exception const& e) {
         // some preprocessing error
@@ -106,9 +956,189 @@ std::string preprocess(std::string_view input, std::string_view filename)
     }
 }
 
-void pre_preprocess(std::string &input)
+}
+
+void preprocess(std::string_view input, std::string_view filename, const PreprocessOptions& options,
+                std::string& processed)
+{
+    processed.clear();
+    auto output = text_output([&processed](std::string_view piece)
+    {
+        processed += piece;
+    });
+    preprocess_into(input, filename, options, output);
+}
+
+void preprocess(std::string_view input, std::string_view filename, const PreprocessOptions& options,
+                size_t chunk_size, const std::function<void(std::string&&)>& consumer)
+{
+    std::string chunk;
+    chunk.reserve(chunk_size);
+    auto output = text_output([chunk_size, &consumer, &chunk](std::string_view piece)
+    {
+        chunk += piece;
+        if (chunk.size() >= chunk_size && chunk.back() == '\n')
+        {
+            consumer(std::move(chunk));
+            chunk.clear();
+            chunk.reserve(chunk_size);
+        }
+    });
+    preprocess_into(input, filename, options, output);
+
+    if (!chunk.empty()) consumer(std::move(chunk));
+}
+
+void preprocess(std::string_view input, std::string_view filename, const PreprocessOptions& options,
+                size_t batch_size, const std::function<void(gsl::span<const PreprocessedLine>)>& consumer)
+{
+    LineBatcher batcher(filename, batch_size, consumer);
+    preprocess_into(input, filename, options, batcher);
+    batcher.finish();
+}
+
+PrecompiledHeader precompile_header(std::string_view input, std::string_view filename,
+                                    const PreprocessOptions& options)
+{
+    PrecompiledHeader header;
+    header.header = filename;
+    header.defines = options.defines;
+    header.sources.push_back({header.header, source_digest(input)});
+    if (options.prelude)
+    {
+        header.sources.insert(header.sources.end(), options.prelude->sources.begin(), options.prelude->sources.end());
+    }
+
+    std::vector<IncludedFile> included_files;
+    PreprocessOptions header_options = options;
+    header_options.included_files = &included_files;
+
+    BlankOutput output;
+    output.file = header.header;
+    preprocess_into(input, filename, header_options, output, &header);
+    if (!output.stray.empty())
+    {
+        pp_error_throw(output.file + "(" + std::to_string(output.line) + "): a precompiled header can only hold "
+                       "directives, it outputs '" + output.stray + "'");
+    }
+
+    for (const auto& file : included_files)
+    {
+        header.sources.push_back({file.filename, source_digest(*file.contents)});
+    }
+    if (options.included_files)
+    {
+        options.included_files->insert(options.included_files->end(), included_files.begin(), included_files.end());
+    }
+
+    header.digest = precompiled_header_digest(header);
+    return header;
+}
+
+void find_comments(std::string_view input, std::vector<size_t>& comments)
+{
+    enum class State
+    {
+        Code,
+        String,
+        // a ';' comment, dropped from the output
+        Comment,
+        // '//' and '/* */' comments, left to the preprocessor
+        LineComment,
+        BlockComment
+    };
+
+    comments.clear();
+    State state { State::Code };
+    size_t block_comment_start { 0 };
+
+    auto handle = [&](size_t pos)
+    {
+        const char c = input[pos];
+        switch (state)
+        {
+            case State::Code:
+                if (c == '"')
+                {
+                    state = State::String;
+                }
+                else if (c == ';')
+                {
+                    comments.push_back(pos);
+                    state = State::Comment;
+                }
+                else if (c == '/' && pos + 1 < input.size() && input[pos + 1] == '/')
+                {
+                    state = State::LineComment;
+                }
+                else if (c == '/' && pos + 1 < input.size() && input[pos + 1] == '*')
+                {
+                    block_comment_start = pos;
+                    state = State::BlockComment;
+                }
+                break;
+            case State::String:
+                if (c == '\n')
+                {
+                    // unterminated, the preprocessor reports it
+                    state = State::Code;
+                }
+                else if (c == '"')
+                {
+                    size_t backslashes { 0 };
+                    while (input[pos - 1 - backslashes] == '\\') ++backslashes;
+                    if (backslashes % 2 == 0) state = State::Code;
+                }
+                break;
+            case State::Comment:
+                if (c == '\n') state = State::Code;
+                break;
+            case State::LineComment:
+                if (c == '\n') state = State::Code;
+                break;
+            case State::BlockComment:
+                if (c == '/' && pos >= block_comment_start + 3 && input[pos - 1] == '*') state = State::Code;
+                break;
+        }
+    };
+
+    // only the characters the state machine cares about are visited, the blocks are searched with SIMD
+    for (size_t block { 0 }; block < input.size(); block += scan_block_size)
+    {
+        uint64_t mask = input.size() - block >= scan_block_size ? scan_block(input.data() + block)
+                                                                : scan_tail(input.data() + block, input.size() - block);
+        while (mask)
+        {
+            handle(block + __builtin_ctzll(mask));
+            mask &= mask - 1;
+        }
+    }
+}
+
+std::string_view remove_comments(std::string_view input, gsl::span<const size_t> comments, std::string &storage)
+{
+    if (comments.empty())
+    {
+        return input;
+    }
+
+    storage.clear();
+    storage.reserve(input.size());
+    size_t kept { 0 };
+    for (size_t comment : comments)
+    {
+        storage.append(input.data() + kept, comment - kept);
+        kept = std::min(input.find('\n', comment), input.size());
+    }
+    storage.append(input.data() + kept, input.size() - kept);
+    return storage;
+}
+
+std::string_view pre_preprocess(std::string_view input, std::string &storage)
 {
-    boost::replace_all(input, ";", "//");
+    std::vector<size_t> comments;
+    find_comments(input, comments);
+    return remove_comments(input, comments, storage);
 }
 
 }
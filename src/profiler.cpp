@@ -0,0 +1,332 @@
+/*
+profiler.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "profiler.hpp"
+#include "trace.hpp"
+#include "alloc_stats.hpp"
+
+#include <time.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+
+namespace floaty
+{
+
+namespace
+{
+
+// innermost phase of the calling thread
+thread_local ScopedPhase* current_phase { nullptr };
+
+double to_ms(uint64_t ns)
+{
+    return ns / 1e6;
+}
+
+}
+
+std::atomic<Profiler*> Profiler::active_profiler { nullptr };
+
+const char *phase_name(Phase phase)
+{
+    switch (phase)
+    {
+        case Phase::Read: return "read";
+        case Phase::PrePreprocess: return "pre_preprocess";
+        case Phase::Preprocess: return "preprocess";
+        case Phase::Parse: return "parse";
+        case Phase::BuildSymbolTable: return "build_symbol_table";
+        case Phase::Encode: return "encode";
+        case Phase::Write: return "write";
+        case Phase::Count: break;
+    }
+    __builtin_unreachable();
+}
+
+const char *phase_unit(Phase phase)
+{
+    switch (phase)
+    {
+        case Phase::Read: return "bytes";
+        case Phase::PrePreprocess: return "bytes";
+        case Phase::Preprocess: return "bytes";
+        case Phase::Parse: return "directives";
+        case Phase::BuildSymbolTable: return "directives";
+        case Phase::Encode: return "directives";
+        case Phase::Write: return "bytes";
+        case Phase::Count: break;
+    }
+    __builtin_unreachable();
+}
+
+uint64_t thread_cpu_time()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+Profiler::Profiler()
+    : start(std::chrono::steady_clock::now())
+{
+}
+
+bool Profiler::enable_hardware_counters(std::string &reason)
+{
+    count_events = hardware_counters_available(reason);
+    return count_events;
+}
+
+void Profiler::record(Phase phase, const PhaseStats& run)
+{
+    auto& phase_counters = counters[(size_t)phase];
+    phase_counters.wall_ns.fetch_add(run.wall_ns, std::memory_order_relaxed);
+    phase_counters.cpu_ns.fetch_add(run.cpu_ns, std::memory_order_relaxed);
+    phase_counters.calls.fetch_add(1, std::memory_order_relaxed);
+    phase_counters.items.fetch_add(run.items, std::memory_order_relaxed);
+    phase_counters.allocations.fetch_add(run.allocations, std::memory_order_relaxed);
+    phase_counters.alloc_bytes.fetch_add(run.alloc_bytes, std::memory_order_relaxed);
+    for (size_t i { 0 }; i < run.events.size(); ++i)
+    {
+        phase_counters.events[i].fetch_add(run.events[i], std::memory_order_relaxed);
+    }
+
+    uint64_t peak = phase_counters.peak_bytes.load(std::memory_order_relaxed);
+    while (run.peak_bytes > peak &&
+           !phase_counters.peak_bytes.compare_exchange_weak(peak, run.peak_bytes, std::memory_order_relaxed))
+    {
+    }
+}
+
+Profiler::PhaseStats Profiler::stats(Phase phase) const
+{
+    const auto& phase_counters = counters[(size_t)phase];
+    PhaseStats result {phase_counters.wall_ns.load(), phase_counters.cpu_ns.load(),
+                       phase_counters.calls.load(), phase_counters.items.load(),
+                       phase_counters.allocations.load(), phase_counters.alloc_bytes.load(),
+                       phase_counters.peak_bytes.load(), {}};
+    for (size_t i { 0 }; i < result.events.size(); ++i)
+    {
+        result.events[i] = phase_counters.events[i].load();
+    }
+    return result;
+}
+
+uint64_t Profiler::elapsed_ns() const
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Profiler::print_text(std::ostream &stream) const
+{
+    char line[200];
+    std::snprintf(line, sizeof(line), "%-20s %12s %12s %8s %12s", "phase", "wall (ms)", "cpu (ms)", "calls", "items");
+    stream << line;
+    if (alloc_stats_enabled)
+    {
+        std::snprintf(line, sizeof(line), " %-10s %10s %12s %12s", "", "allocs", "alloc bytes", "peak bytes");
+        stream << line;
+    }
+    stream << "\n";
+
+    for (size_t i { 0 }; i < (size_t)Phase::Count; ++i)
+    {
+        auto phase_stats = stats(Phase(i));
+        std::snprintf(line, sizeof(line), alloc_stats_enabled ? "%-20s %12.3f %12.3f %8llu %12llu %-10s" : "%-20s %12.3f %12.3f %8llu %12llu %s", phase_name(Phase(i)),
+                      to_ms(phase_stats.wall_ns), to_ms(phase_stats.cpu_ns),
+                      (unsigned long long)phase_stats.calls, (unsigned long long)phase_stats.items,
+                      phase_unit(Phase(i)));
+        stream << line;
+        if (alloc_stats_enabled)
+        {
+            std::snprintf(line, sizeof(line), " %10llu %12llu %12llu", (unsigned long long)phase_stats.allocations,
+                          (unsigned long long)phase_stats.alloc_bytes, (unsigned long long)phase_stats.peak_bytes);
+            stream << line;
+        }
+        stream << "\n";
+    }
+
+    std::snprintf(line, sizeof(line), "%-20s %12.3f\n", "total", to_ms(elapsed_ns()));
+    stream << line;
+
+    if (count_events) print_hardware_text(stream);
+}
+
+void Profiler::print_hardware_text(std::ostream &stream) const
+{
+    char line[200];
+    stream << "\n";
+    std::snprintf(line, sizeof(line), "%-20s %16s %16s %8s %14s %14s\n", "phase",
+                  "cycles", "instructions", "ipc", "branch misses", "llc misses");
+    stream << line;
+
+    auto count = [](const PhaseStats& phase_stats, HardwareEvent event)
+    {
+        if (!hardware_event_supported(event)) return std::string("-");
+        return std::to_string(phase_stats.events[(size_t)event]);
+    };
+
+    for (size_t i { 0 }; i < (size_t)Phase::Count; ++i)
+    {
+        auto phase_stats = stats(Phase(i));
+        const uint64_t cycles = phase_stats.events[(size_t)HardwareEvent::Cycles];
+        const uint64_t instructions = phase_stats.events[(size_t)HardwareEvent::Instructions];
+        std::string ipc = "-";
+        if (cycles != 0 && hardware_event_supported(HardwareEvent::Instructions))
+        {
+            char number[32];
+            std::snprintf(number, sizeof(number), "%.2f", double(instructions) / cycles);
+            ipc = number;
+        }
+
+        std::snprintf(line, sizeof(line), "%-20s %16s %16s %8s %14s %14s\n", phase_name(Phase(i)),
+                      count(phase_stats, HardwareEvent::Cycles).c_str(),
+                      count(phase_stats, HardwareEvent::Instructions).c_str(), ipc.c_str(),
+                      count(phase_stats, HardwareEvent::BranchMisses).c_str(),
+                      count(phase_stats, HardwareEvent::CacheMisses).c_str());
+        stream << line;
+    }
+}
+
+void Profiler::print_json(std::ostream &stream) const
+{
+    auto ms = [](uint64_t ns)
+    {
+        char number[32];
+        std::snprintf(number, sizeof(number), "%.3f", to_ms(ns));
+        return std::string(number);
+    };
+
+    stream << "{\n  \"total_wall_ms\": " << ms(elapsed_ns()) << ",\n  \"phases\": [";
+    for (size_t i { 0 }; i < (size_t)Phase::Count; ++i)
+    {
+        auto phase_stats = stats(Phase(i));
+        stream << (i ? ",\n" : "\n")
+               << "    {\"name\": \"" << phase_name(Phase(i)) << "\", "
+               << "\"wall_ms\": " << ms(phase_stats.wall_ns) << ", "
+               << "\"cpu_ms\": " << ms(phase_stats.cpu_ns) << ", "
+               << "\"calls\": " << phase_stats.calls << ", "
+               << "\"items\": " << phase_stats.items << ", "
+               << "\"unit\": \"" << phase_unit(Phase(i)) << "\"";
+        if (alloc_stats_enabled)
+        {
+            stream << ", \"allocations\": " << phase_stats.allocations << ", "
+                   << "\"alloc_bytes\": " << phase_stats.alloc_bytes << ", "
+                   << "\"peak_bytes\": " << phase_stats.peak_bytes;
+        }
+        if (count_events)
+        {
+            // unsupported events are left out rather than reported as zero
+            for (size_t event { 0 }; event < (size_t)HardwareEvent::Count; ++event)
+            {
+                if (!hardware_event_supported(HardwareEvent(event))) continue;
+                stream << ", \"" << hardware_event_name(HardwareEvent(event)) << "\": " << phase_stats.events[event];
+            }
+        }
+        stream << "}";
+    }
+    stream << "\n  ]\n}\n";
+}
+
+ScopedPhase::ScopedPhase(Phase phase)
+    : profiler(Profiler::active()), tracer(TraceWriter::active()), phase(phase)
+{
+    if (tracer) trace_start = tracer->now();
+    if (!profiler) return;
+
+    parent = current_phase;
+    if (parent) parent->pause();
+    current_phase = this;
+
+    if (alloc_stats_enabled)
+    {
+        auto& allocs = thread_allocs();
+        live_start = allocs.live;
+        outer_peak = allocs.peak;
+        allocs.peak = allocs.live;
+    }
+    resume();
+}
+
+ScopedPhase::~ScopedPhase()
+{
+    if (profiler)
+    {
+        pause();
+        if (alloc_stats_enabled)
+        {
+            auto& allocs = thread_allocs();
+            run.peak_bytes = std::max<int64_t>(allocs.peak - live_start, 0);
+            allocs.peak = std::max(allocs.peak, outer_peak);
+        }
+        profiler->record(phase, run);
+
+        current_phase = parent;
+        if (parent) parent->resume();
+    }
+
+    if (tracer) tracer->complete("phase", phase_name(phase), trace_start, run.items);
+}
+
+void ScopedPhase::pause()
+{
+    if (!profiler) return;
+
+    run.wall_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - wall_start).count();
+    run.cpu_ns += thread_cpu_time() - cpu_start;
+    if (alloc_stats_enabled)
+    {
+        const auto& allocs = thread_allocs();
+        run.allocations += allocs.count - allocations_start;
+        run.alloc_bytes += allocs.bytes - alloc_bytes_start;
+    }
+    if (profiler->hardware_counters())
+    {
+        const auto events = thread_hardware_counts();
+        for (size_t i { 0 }; i < events.size(); ++i)
+        {
+            run.events[i] += events[i] - events_start[i];
+        }
+    }
+}
+
+void ScopedPhase::resume()
+{
+    if (!profiler) return;
+
+    wall_start = std::chrono::steady_clock::now();
+    cpu_start = thread_cpu_time();
+    if (alloc_stats_enabled)
+    {
+        const auto& allocs = thread_allocs();
+        allocations_start = allocs.count;
+        alloc_bytes_start = allocs.bytes;
+    }
+    if (profiler->hardware_counters()) events_start = thread_hardware_counts();
+}
+
+}
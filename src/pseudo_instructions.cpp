@@ -83,8 +83,9 @@ size_t handle_seek_directive(const Instruction &ins, size_t old_idx)
     return seek_addr;
 }
 
-std::vector<uint8_t> handle_data_insert_directive(const Instruction &ins)
+void handle_data_insert_directive(const Instruction &ins, std::vector<uint8_t> &data)
 {
+    data.clear();
     if (toupper(ins.mnemo[1]) == 'S')
     {
         if (ins.arguments.size() != 1 || !is_string(ins.arguments[0]))
@@ -94,14 +95,13 @@ std::vector<uint8_t> handle_data_insert_directive(const Instruction &ins)
 
         // TODO : handle escape codes
         auto str = unquoted(ins.arguments[0]);
-        return std::vector<uint8_t>{str.begin(), str.end()};
+        data.assign(str.begin(), str.end());
     }
     else
     {
         size_t width = toupper(ins.mnemo[1]) == 'B' ? 1 : toupper(ins.mnemo[1]) == 'W' ? 2 : toupper(ins.mnemo[1]) == 'D' ? 4 : 0;
         if (width == 0) assembler_error_throw("invalid data pseudo instruction width", ins.line, ins.filename);
 
-        std::vector<uint8_t> data;
         for (size_t i { 0 }; i < ins.arguments.size(); ++i)
         {
             const auto& arg = ins.arguments[i];
@@ -116,7 +116,6 @@ std::vector<uint8_t> handle_data_insert_directive(const Instruction &ins)
                 value >>= 8;
             }
         }
-        return data;
     }
 }
 
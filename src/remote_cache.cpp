@@ -0,0 +1,176 @@
+/*
+remote_cache.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "remote_cache.hpp"
+
+#include <chrono>
+#include <cstdlib>
+
+#include "stl_utils.hpp"
+
+namespace floaty
+{
+
+RemoteCache::RemoteCache(const Endpoint &endpoint, std::chrono::milliseconds timeout)
+{
+    int fd = connect_to(endpoint, timeout);
+    if (fd < 0)
+    {
+        broken = true;
+        return;
+    }
+
+    stream = std::make_unique<SocketStream>(fd);
+    reader = std::thread([this] { read_responses(); });
+}
+
+RemoteCache::~RemoteCache()
+{
+    if (!stream) return;
+
+    {
+        // give the last PUTs a chance to reach the server
+        std::unique_lock<std::mutex> lock(mutex);
+        drained.wait_for(lock, std::chrono::seconds(2), [this] { return pending.empty() || broken; });
+    }
+
+    stream->shutdown();
+    reader.join();
+}
+
+std::future<CachedImage> RemoteCache::get(const std::string &key)
+{
+    std::promise<CachedImage> promise;
+    auto future = promise.get_future();
+
+    send("GET /cache/" + key + " HTTP/1.1\r\nHost: floaty-cache\r\n\r\n", std::move(promise));
+
+    return future;
+}
+
+void RemoteCache::put(const std::string &key, gsl::span<const uint8_t> data)
+{
+    std::string request = "PUT /cache/" + key + " HTTP/1.1\r\nHost: floaty-cache\r\n"
+            "Content-Type: application/octet-stream\r\n"
+            "Content-Length: " + std::to_string(data.size()) + "\r\n\r\n";
+    request.append((const char*)data.data(), data.size());
+
+    send(request, std::promise<CachedImage>{});
+}
+
+void RemoteCache::send(const std::string &request, std::promise<CachedImage> promise)
+{
+    // writes are serialized separately so that the reader never waits behind a large PUT
+    std::lock_guard<std::mutex> write_lock(write_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (broken)
+        {
+            promise.set_value(std::nullopt);
+            return;
+        }
+
+        // queue the promise before writing so the reader always finds it
+        pending.emplace_back(std::move(promise));
+    }
+
+    if (!stream->write_all(request))
+    {
+        // a request may have been cut short, the connection can't be used again
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            broken = true;
+        }
+        // the reader fails the pending requests once it notices the connection is gone
+        stream->shutdown();
+    }
+}
+
+void RemoteCache::read_responses()
+{
+    while (true)
+    {
+        auto status_line = stream->read_line();
+        if (!status_line) break;
+
+        // "HTTP/1.1 <code> <reason>"
+        auto fields = split(*status_line, " ");
+        if (fields.size() < 2) break;
+        const bool found = fields[1] == "200";
+
+        size_t content_length { 0 };
+        bool headers_ok { true };
+        while (true)
+        {
+            auto header = stream->read_line();
+            if (!header)
+            {
+                headers_ok = false;
+                break;
+            }
+            if (header->empty()) break;
+
+            auto colon = header->find(':');
+            if (colon != std::string::npos && to_lower(header->substr(0, colon)) == "content-length")
+            {
+                content_length = std::strtoul(header->c_str() + colon + 1, nullptr, 10);
+            }
+        }
+        if (!headers_ok) break;
+
+        auto body = stream->read_bytes(content_length);
+        if (!body) break;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (pending.empty()) break; // answer to nothing, the stream is out of sync
+
+        if (found)
+        {
+            pending.front().set_value(std::vector<uint8_t>(body->begin(), body->end()));
+        }
+        else
+        {
+            pending.front().set_value(std::nullopt);
+        }
+        pending.pop_front();
+        if (pending.empty()) drained.notify_all();
+    }
+
+    fail_pending();
+}
+
+void RemoteCache::fail_pending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    broken = true;
+    for (auto& promise : pending)
+    {
+        promise.set_value(std::nullopt);
+    }
+    pending.clear();
+    drained.notify_all();
+}
+
+}
@@ -0,0 +1,253 @@
+/*
+server.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "server.hpp"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+
+#include <charconv>
+#include <iostream>
+#include <optional>
+#include <thread>
+
+#include "driver.hpp"
+#include "include_cache.hpp"
+#include "source_file.hpp"
+#include "output_file.hpp"
+#include "socket_stream.hpp"
+#include "stl_utils.hpp"
+
+namespace floaty
+{
+
+namespace
+{
+
+char socket_path_copy[sizeof(sockaddr_un::sun_path)];
+
+extern "C" void on_termination(int)
+{
+    ::unlink(socket_path_copy);
+    ::_exit(0);
+}
+
+bool answer(SocketStream& conn, const std::string& header, std::string_view payload)
+{
+    std::string message = header + "\n";
+    message.append(payload.data(), payload.size());
+    return conn.write_all(message);
+}
+
+// Answers with an error and asks for the connection to be closed
+bool reject(SocketStream& conn, const std::string& error)
+{
+    answer(conn, "ERROR -16 " + std::to_string(error.size()), error);
+    return false;
+}
+
+struct Request
+{
+    std::optional<std::string> source_file;
+    std::optional<std::string> source_text;
+    std::string source_name { "<stdin>" };
+    std::string output;
+    std::vector<std::string> defines;
+};
+
+// Returns false when the connection must be closed
+bool handle_request(SocketStream& conn, IncludeCache& include_cache)
+{
+    std::optional<std::string> line;
+    do
+    {
+        line = conn.read_line();
+        if (!line) return false;
+    } while (trim(*line).empty());
+
+    if (trim(*line) != "ASSEMBLE")
+    {
+        return reject(conn, "unknown request '" + std::string(trim(*line)) + "'");
+    }
+
+    Request req;
+    while (true)
+    {
+        line = conn.read_line();
+        if (!line) return false;
+        auto content = trim(*line);
+        if (content.empty()) break;
+
+        auto space = content.find(' ');
+        auto key = content.substr(0, space);
+        auto value = space == std::string_view::npos ? std::string_view{} : trim(content.substr(space + 1));
+
+        if (key == "file")
+        {
+            req.source_file = std::string(value);
+        }
+        else if (key == "text")
+        {
+            auto fields = split(value, " ");
+            const std::string_view size_field = fields.empty() ? std::string_view{} : fields[0];
+            const char* size_end = size_field.data() + size_field.size();
+            size_t size { 0 };
+            const auto parsed = std::from_chars(size_field.data(), size_end, size);
+            // out of range values are consumed whole too
+            if (size_field.empty() || parsed.ec != std::errc{} || parsed.ptr != size_end)
+            {
+                return reject(conn, "invalid text size '" + std::string(size_field) + "'");
+            }
+            if (fields.size() > 1) req.source_name = std::string(value.substr(fields[1].data() - value.data()));
+
+            req.source_text = conn.read_bytes(size);
+            if (!req.source_text) return false;
+        }
+        else if (key == "define")
+        {
+            req.defines.emplace_back(value);
+        }
+        else if (key == "output")
+        {
+            req.output = std::string(value);
+        }
+        else
+        {
+            return reject(conn, "unknown request field '" + std::string(key) + "'");
+        }
+    }
+
+    VectorSink image;
+    auto result = run_guarded([&req, &image, &include_cache]
+    {
+        PreprocessOptions options;
+        options.defines = req.defines;
+        options.loader = &include_cache;
+
+        // with an output file the image is assembled straight into it and only the status is sent back
+        std::optional<OutputFile> output;
+        if (!req.output.empty()) output.emplace(req.output);
+        OutputSink& sink = output ? static_cast<OutputSink&>(*output) : image;
+
+        if (req.source_file)
+        {
+            SourceFile source(*req.source_file);
+            assemble_source(source.view(), *req.source_file, options, sink);
+        }
+        else if (req.source_text)
+        {
+            assemble_source(*req.source_text, req.source_name, options, sink);
+        }
+        else
+        {
+            throw io_error("No input file");
+        }
+
+        if (output) output->commit();
+
+        return std::string{};
+    });
+
+    if (result.status != 0)
+    {
+        return answer(conn, "ERROR " + std::to_string(result.status) + " " + std::to_string(result.message.size()),
+                      result.message);
+    }
+
+    return answer(conn, "OK " + std::to_string(image.data.size()),
+                  std::string_view((const char*)image.data.data(), image.data.size()));
+}
+
+}
+
+int serve(const std::string &socket_path)
+{
+    if (socket_path.size() >= sizeof(socket_path_copy))
+    {
+        std::cerr << "Socket path too long : " << socket_path << std::endl;
+        return -16;
+    }
+
+    std::strcpy(socket_path_copy, socket_path.c_str());
+
+    Endpoint endpoint;
+    endpoint.path = socket_path;
+    int listen_fd = listen_on(endpoint);
+    if (listen_fd < 0)
+    {
+        std::cerr << "Could not listen on " << socket_path << " : " << std::strerror(errno) << std::endl;
+        return -16;
+    }
+
+    std::signal(SIGINT, on_termination);
+    std::signal(SIGTERM, on_termination);
+
+    // Run a tiny program once so Wave's grammars and the opcode tables are initialized before the first request.
+    // It needs a directive, sources without any don't go through Wave.
+    run_guarded([] { assemble_source("#define WARMUP 1\nNOP\n", "<warmup>", {}); return std::string{}; });
+
+    IncludeCache include_cache;
+
+    std::cout << "Listening on " << socket_path << std::endl;
+
+    while (true)
+    {
+        int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "accept failed : " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        std::thread([fd, &include_cache]
+        {
+            SocketStream conn(fd);
+            // whatever a client sends, only its own connection ends
+            try
+            {
+                while (handle_request(conn, include_cache)) {}
+            }
+            catch (const std::exception& e)
+            {
+                std::string error = "internal error : " + std::string(e.what());
+                answer(conn, "ERROR -4 " + std::to_string(error.size()), error);
+            }
+            catch (...)
+            {
+            }
+        }).detach();
+    }
+
+    ::close(listen_fd);
+    ::unlink(socket_path.c_str());
+    return -16;
+}
+
+}
@@ -0,0 +1,326 @@
+/*
+socket_stream.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "socket_stream.hpp"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include <stdexcept>
+
+namespace floaty
+{
+
+namespace
+{
+
+// connect() bounded by 'timeout' when it is positive, in which case sends are bounded by it as well
+bool connect_socket(int fd, const sockaddr* addr, socklen_t size, std::chrono::milliseconds timeout)
+{
+    if (timeout.count() <= 0)
+    {
+        return ::connect(fd, addr, size) == 0;
+    }
+
+    const int flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        return false;
+    }
+
+    if (::connect(fd, addr, size) < 0)
+    {
+        if (errno != EINPROGRESS) return false;
+
+        pollfd pfd { fd, POLLOUT, 0 };
+        int ready;
+        do
+        {
+            ready = ::poll(&pfd, 1, timeout.count());
+        } while (ready < 0 && errno == EINTR);
+        if (ready <= 0)
+        {
+            if (ready == 0) errno = ETIMEDOUT;
+            return false;
+        }
+
+        int error { 0 };
+        socklen_t error_size = sizeof(error);
+        if (::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_size) < 0) return false;
+        if (error != 0)
+        {
+            errno = error;
+            return false;
+        }
+    }
+
+    if (::fcntl(fd, F_SETFL, flags) < 0)
+    {
+        return false;
+    }
+
+    // a peer that stops reading makes send() fail instead of blocking
+    timeval send_timeout {};
+    send_timeout.tv_sec = timeout.count() / 1000;
+    send_timeout.tv_usec = (timeout.count() % 1000) * 1000;
+    return ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout)) == 0;
+}
+
+}
+
+Endpoint parse_endpoint(std::string_view str)
+{
+    Endpoint endpoint;
+
+    if (str.compare(0, 5, "unix:") == 0)
+    {
+        endpoint.path = std::string(str.substr(5));
+        return endpoint;
+    }
+
+    for (std::string_view scheme : {"http://", "tcp://"})
+    {
+        if (str.compare(0, scheme.size(), scheme) == 0)
+        {
+            str.remove_prefix(scheme.size());
+            str = str.substr(0, str.find('/'));
+
+            auto colon = str.rfind(':');
+            if (colon == std::string_view::npos || colon + 1 == str.size())
+            {
+                throw std::invalid_argument("missing port in endpoint '" + std::string(str) + "'");
+            }
+
+            endpoint.is_unix = false;
+            endpoint.host = std::string(str.substr(0, colon));
+            endpoint.port = std::string(str.substr(colon + 1));
+            return endpoint;
+        }
+    }
+
+    // a bare path is a Unix domain socket
+    endpoint.path = std::string(str);
+    return endpoint;
+}
+
+int connect_to(const Endpoint &endpoint, std::chrono::milliseconds timeout)
+{
+    if (endpoint.is_unix)
+    {
+        sockaddr_un addr {};
+        if (endpoint.path.size() >= sizeof(addr.sun_path))
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, endpoint.path.c_str());
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        if (!connect_socket(fd, (sockaddr*)&addr, sizeof(addr), timeout))
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    addrinfo hints {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* results;
+    if (::getaddrinfo(endpoint.host.c_str(), endpoint.port.c_str(), &hints, &results) != 0)
+    {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    int fd { -1 };
+    for (auto* info = results; info; info = info->ai_next)
+    {
+        fd = ::socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+        if (fd < 0) continue;
+        if (connect_socket(fd, info->ai_addr, info->ai_addrlen, timeout))
+        {
+            int one { 1 };
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            break;
+        }
+        ::close(fd);
+        fd = -1;
+    }
+    ::freeaddrinfo(results);
+
+    return fd;
+}
+
+int listen_on(const Endpoint &endpoint, int backlog)
+{
+    int fd { -1 };
+
+    if (endpoint.is_unix)
+    {
+        sockaddr_un addr {};
+        if (endpoint.path.size() >= sizeof(addr.sun_path))
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        addr.sun_family = AF_UNIX;
+        std::strcpy(addr.sun_path, endpoint.path.c_str());
+
+        // a stale socket left by a previous server would make bind() fail
+        struct stat st;
+        if (::stat(endpoint.path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        {
+            ::unlink(endpoint.path.c_str());
+        }
+
+        fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) return -1;
+        if (::bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+    }
+    else
+    {
+        addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+
+        addrinfo* results;
+        const char* host = endpoint.host.empty() ? nullptr : endpoint.host.c_str();
+        if (::getaddrinfo(host, endpoint.port.c_str(), &hints, &results) != 0)
+        {
+            errno = EADDRNOTAVAIL;
+            return -1;
+        }
+
+        for (auto* info = results; info; info = info->ai_next)
+        {
+            fd = ::socket(info->ai_family, info->ai_socktype | SOCK_CLOEXEC, info->ai_protocol);
+            if (fd < 0) continue;
+            int one { 1 };
+            ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (::bind(fd, info->ai_addr, info->ai_addrlen) == 0) break;
+            ::close(fd);
+            fd = -1;
+        }
+        ::freeaddrinfo(results);
+        if (fd < 0) return -1;
+    }
+
+    if (::listen(fd, backlog) < 0)
+    {
+        ::close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+SocketStream::~SocketStream()
+{
+    ::close(fd);
+}
+
+std::optional<std::string> SocketStream::read_line()
+{
+    size_t searched { 0 };
+    while (true)
+    {
+        auto pos = buffer.find('\n', searched);
+        if (pos != std::string::npos)
+        {
+            std::string line = buffer.substr(0, pos);
+            buffer.erase(0, pos + 1);
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            return line;
+        }
+        searched = buffer.size();
+        if (!fill()) return {};
+    }
+}
+
+std::optional<std::string> SocketStream::read_bytes(size_t size)
+{
+    while (buffer.size() < size)
+    {
+        if (!fill()) return {};
+    }
+
+    std::string data = buffer.substr(0, size);
+    buffer.erase(0, size);
+    return data;
+}
+
+bool SocketStream::write_all(std::string_view data)
+{
+    while (!data.empty())
+    {
+        ssize_t count = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (count < 0)
+        {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data.remove_prefix(count);
+    }
+    return true;
+}
+
+void SocketStream::shutdown()
+{
+    ::shutdown(fd, SHUT_RDWR);
+}
+
+bool SocketStream::fill()
+{
+    char chunk[64*1024];
+    while (true)
+    {
+        ssize_t count = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (count < 0 && errno == EINTR) continue;
+        if (count <= 0) return false;
+        buffer.append(chunk, count);
+        return true;
+    }
+}
+
+}
@@ -0,0 +1,90 @@
+/*
+source_file.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "source_file.hpp"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace floaty
+{
+
+SourceFile::SourceFile(const std::string &filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        io_error_throw("Could not open input file", filename);
+    }
+
+    // procfs and sysfs files claim a size of 0 whatever they hold, they are read like a stream
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        size = st.st_size;
+        void* addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            ::madvise(addr, size, MADV_SEQUENTIAL);
+            mapping = addr;
+            contents = static_cast<const char*>(addr);
+            ::close(fd);
+            return;
+        }
+    }
+
+    // not mappable (pipe, tty, procfs...), fall back to reading the stream
+    char chunk[64*1024];
+    while (true)
+    {
+        ssize_t count = ::read(fd, chunk, sizeof(chunk));
+        if (count < 0)
+        {
+            if (errno == EINTR) continue;
+            ::close(fd);
+            io_error_throw("Could not read input file", filename);
+        }
+        if (count == 0) break;
+        buffer.append(chunk, count);
+    }
+    ::close(fd);
+
+    contents = buffer.data();
+    size = buffer.size();
+}
+
+SourceFile::~SourceFile()
+{
+    if (mapping)
+    {
+        ::munmap(mapping, size);
+    }
+}
+
+}
@@ -0,0 +1,162 @@
+/*
+thread_pool.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "thread_pool.hpp"
+
+namespace floaty
+{
+
+namespace
+{
+thread_local int worker_index { -1 };
+}
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+    if (thread_count == 0) thread_count = 1;
+
+    for (size_t i { 0 }; i < thread_count; ++i)
+    {
+        workers.emplace_back(std::make_unique<Worker>());
+    }
+    for (size_t i { 0 }; i < thread_count; ++i)
+    {
+        workers[i]->thread = std::thread([this, i] { run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+
+    for (auto& worker : workers)
+    {
+        worker->thread.join();
+    }
+}
+
+void ThreadPool::submit(Task task)
+{
+    size_t target;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        ++unfinished;
+        ++queued;
+        target = next_worker;
+        next_worker = (next_worker + 1) % workers.size();
+    }
+
+    {
+        auto& worker = *workers[target];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.emplace_back(std::move(task));
+    }
+    work_available.notify_one();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(state_mutex);
+    work_done.wait(lock, [this] { return unfinished == 0; });
+}
+
+int ThreadPool::current_worker()
+{
+    return worker_index;
+}
+
+size_t ThreadPool::default_thread_count()
+{
+    auto count = std::thread::hardware_concurrency();
+    return count ? count : 1;
+}
+
+bool ThreadPool::pop_task(size_t index, Task &task)
+{
+    auto& worker = *workers[index];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tasks.empty()) return false;
+
+    task = std::move(worker.tasks.front());
+    worker.tasks.pop_front();
+    return true;
+}
+
+bool ThreadPool::steal_task(size_t index, Task &task)
+{
+    for (size_t i { 1 }; i < workers.size(); ++i)
+    {
+        auto& victim = *workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.tasks.empty()) continue;
+
+        task = std::move(victim.tasks.back());
+        victim.tasks.pop_back();
+        return true;
+    }
+
+    return false;
+}
+
+void ThreadPool::run(size_t index)
+{
+    worker_index = index;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(state_mutex);
+            work_available.wait(lock, [this] { return stopping || queued > 0; });
+            if (queued == 0 && stopping) return;
+        }
+
+        Task task;
+        if (!pop_task(index, task) && !steal_task(index, task))
+        {
+            // the task is not pushed yet or another worker grabbed it first
+            std::this_thread::yield();
+            continue;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            --queued;
+        }
+
+        task();
+
+        std::lock_guard<std::mutex> lock(state_mutex);
+        if (--unfinished == 0)
+        {
+            work_done.notify_all();
+        }
+    }
+}
+
+}
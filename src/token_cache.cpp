@@ -0,0 +1,167 @@
+/*
+token_cache.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "token_cache.hpp"
+
+#include <cstring>
+
+#include <filesystem>
+#include <string>
+
+#include <boost/wave/wave_version.hpp>
+
+#include "build_cache.hpp"
+#include "hasher.hpp"
+
+namespace fs = std::filesystem;
+
+namespace floaty
+{
+
+namespace
+{
+
+struct EntryHeader
+{
+    char magic[4];
+    uint32_t token_count;
+    uint32_t values_size;
+    uint32_t reserved;
+};
+
+constexpr char entry_magic[4] = { 'F', 'T', 'K', '1' };
+
+}
+
+TokenStream::TokenStream(const std::string &path)
+    : file(path)
+{
+    const auto contents = file.view();
+
+    EntryHeader header;
+    if (contents.size() < sizeof(header))
+    {
+        io_error_throw("Truncated token cache entry", path);
+    }
+    std::memcpy(&header, contents.data(), sizeof(header));
+
+    const uint64_t tokens_size = uint64_t(header.token_count) * sizeof(CachedToken);
+    if (std::memcmp(header.magic, entry_magic, sizeof(entry_magic)) != 0
+        || contents.size() != sizeof(header) + tokens_size + header.values_size)
+    {
+        io_error_throw("Malformed token cache entry", path);
+    }
+
+    // the header keeps the tokens aligned, the mapping or buffer being aligned itself
+    token_span = gsl::make_span(reinterpret_cast<const CachedToken*>(contents.data() + sizeof(header)),
+                                header.token_count);
+    values = contents.substr(sizeof(header) + tokens_size);
+
+    for (const auto& token : token_span)
+    {
+        if (uint64_t(token.value_offset) + token.value_size > values.size())
+        {
+            io_error_throw("Malformed token cache entry", path);
+        }
+    }
+}
+
+TokenCache::TokenCache(std::string directory)
+    : directory(std::move(directory))
+{
+    std::error_code ec;
+    fs::create_directories(this->directory + "/tokens", ec);
+    fs::create_directories(this->directory + "/tmp", ec);
+    if (ec)
+    {
+        io_error_throw("Could not create token cache directory", this->directory);
+    }
+}
+
+std::string TokenCache::key(std::string_view contents, uint32_t language)
+{
+    Hasher hasher;
+    // the token ids are Wave's
+    hasher.add("tokens-1 wave-" + std::to_string(BOOST_WAVE_VERSION));
+    hasher.add(std::to_string(language));
+    hasher.add(contents);
+    return hasher.hex_digest();
+}
+
+std::shared_ptr<const TokenStream> TokenCache::lookup(const std::string &key) const
+{
+    const auto path = entry_path(key);
+    if (!fs::exists(path))
+    {
+        return nullptr;
+    }
+
+    try
+    {
+        return std::make_shared<const TokenStream>(path);
+    }
+    catch (const io_error&)
+    {
+        return nullptr;
+    }
+}
+
+void TokenCache::store(const std::string &key, gsl::span<const CachedToken> tokens, std::string_view values)
+{
+    if (tokens.size() > UINT32_MAX || values.size() > UINT32_MAX)
+    {
+        return;
+    }
+
+    EntryHeader header {};
+    std::memcpy(header.magic, entry_magic, sizeof(entry_magic));
+    header.token_count = tokens.size();
+    header.values_size = values.size();
+
+    std::string data;
+    data.reserve(sizeof(header) + tokens.size_bytes() + values.size());
+    data.append((const char*)&header, sizeof(header));
+    data.append((const char*)tokens.data(), tokens.size_bytes());
+    data.append(values);
+
+    try
+    {
+        const auto path = entry_path(key);
+        std::error_code ec;
+        fs::create_directories(fs::path(path).parent_path(), ec);
+        write_file_atomically(path, directory + "/tmp",
+                              gsl::span<const uint8_t>((const uint8_t*)data.data(), data.size()));
+    }
+    catch (const io_error&)
+    {
+    }
+}
+
+std::string TokenCache::entry_path(const std::string &key) const
+{
+    return directory + "/tokens/" + key.substr(0, 2) + "/" + key.substr(2);
+}
+
+}
@@ -0,0 +1,208 @@
+/*
+trace.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "trace.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+#include "source_file.hpp"
+#include "thread_pool.hpp"
+
+namespace floaty
+{
+
+namespace
+{
+
+std::atomic<unsigned> next_generation { 0 };
+
+// buffer of the calling thread in the writer of the given generation
+thread_local unsigned buffer_generation { ~0u };
+thread_local void* buffer_ptr { nullptr };
+// set by TraceWriter::set_thread_name()
+thread_local std::string thread_name;
+
+std::string json_escaped(std::string_view str)
+{
+    std::string result;
+    result.reserve(str.size());
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            result += '\\';
+            result += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            char escape[8];
+            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+            result += escape;
+        }
+        else
+        {
+            result += c;
+        }
+    }
+    return result;
+}
+
+std::string microseconds(uint64_t ns)
+{
+    char number[32];
+    std::snprintf(number, sizeof(number), "%llu.%03llu",
+                  (unsigned long long)(ns / 1000), (unsigned long long)(ns % 1000));
+    return number;
+}
+
+}
+
+std::atomic<TraceWriter*> TraceWriter::active_writer { nullptr };
+
+TraceWriter::TraceWriter()
+    : start(std::chrono::steady_clock::now()), generation(next_generation++)
+{
+}
+
+void TraceWriter::set_thread_name(std::string_view name)
+{
+    thread_name = name;
+
+    // the calling thread may already have a track
+    TraceWriter* writer = active();
+    if (writer && buffer_generation == writer->generation)
+    {
+        std::lock_guard<std::mutex> lock(writer->mutex);
+        static_cast<ThreadBuffer*>(buffer_ptr)->thread_name = thread_name;
+    }
+}
+
+void TraceWriter::complete(const char *category, const char *name, uint64_t start_ns, int64_t items)
+{
+    const uint64_t end_ns = now();
+    thread_buffer().events.push_back({'X', category, name, {}, start_ns, end_ns - start_ns, items});
+}
+
+void TraceWriter::complete(const char *category, std::string name, uint64_t start_ns, int64_t items)
+{
+    const uint64_t end_ns = now();
+    thread_buffer().events.push_back({'X', category, nullptr, std::move(name), start_ns, end_ns - start_ns, items});
+}
+
+void TraceWriter::count(const char *name, int64_t delta)
+{
+    const uint64_t timestamp = now();
+
+    int64_t value { 0 };
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto counter = std::find_if(counters.begin(), counters.end(), [name](const Counter& counter)
+        {
+            return counter.name == name;
+        });
+        if (counter == counters.end())
+        {
+            counters.push_back({name, 0});
+            counter = counters.end() - 1;
+        }
+        value = counter->value += delta;
+    }
+
+    thread_buffer().events.push_back({'C', "counter", name, {}, timestamp, 0, value});
+}
+
+TraceWriter::ThreadBuffer &TraceWriter::thread_buffer()
+{
+    if (buffer_generation == generation)
+    {
+        return *static_cast<ThreadBuffer*>(buffer_ptr);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->tid = buffers.size() + 1;
+    const int worker = ThreadPool::current_worker();
+    if (!thread_name.empty())
+    {
+        buffer->thread_name = thread_name;
+    }
+    else
+    {
+        buffer->thread_name = worker >= 0 ? "worker " + std::to_string(worker) : "main";
+    }
+
+    buffer_generation = generation;
+    buffer_ptr = buffer.get();
+    buffers.emplace_back(std::move(buffer));
+
+    return *buffers.back();
+}
+
+void TraceWriter::write(const std::string &filename) const
+{
+    std::ofstream stream(filename, std::ios::trunc);
+    if (!stream.is_open())
+    {
+        io_error_throw("Could not open trace file", filename);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    stream << "{\"ph\": \"M\", \"pid\": 1, \"name\": \"process_name\", \"args\": {\"name\": \"FloatyChipAsm\"}}";
+    for (const auto& buffer : buffers)
+    {
+        stream << ",\n{\"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+               << ", \"name\": \"thread_name\", \"args\": {\"name\": \"" << json_escaped(buffer->thread_name) << "\"}}";
+
+        for (const auto& event : buffer->events)
+        {
+            const std::string name = json_escaped(event.static_name ? event.static_name : event.name);
+            stream << ",\n{\"ph\": \"" << event.type << "\", \"pid\": 1, \"tid\": " << buffer->tid
+                   << ", \"cat\": \"" << event.category << "\", \"name\": \"" << name << "\""
+                   << ", \"ts\": " << microseconds(event.start_ns);
+            if (event.type == 'X')
+            {
+                stream << ", \"dur\": " << microseconds(event.duration_ns);
+                if (event.value >= 0) stream << ", \"args\": {\"items\": " << event.value << "}";
+            }
+            else
+            {
+                stream << ", \"args\": {\"" << name << "\": " << event.value << "}";
+            }
+            stream << "}";
+        }
+    }
+    stream << "\n]}\n";
+
+    if (!stream)
+    {
+        io_error_throw("Could not write trace file", filename);
+    }
+}
+
+}
@@ -0,0 +1,485 @@
+/*
+bench.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+// End-to-end throughput benchmark : assembles generated corpora (see corpus.hpp) and reports the throughput of
+// every pipeline stage, measured by the profiler, and of the whole chain.
+// With --baseline it is also the performance regression gate of the test suite : the stage times and the peak
+// memory are compared to a previous --json output and the run fails when one of them got worse than allowed.
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <optional>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "corpus.hpp"
+#include "floatyasm.hpp"
+#include "json_reader.hpp"
+#include "profiler.hpp"
+#include "source_file.hpp"
+
+namespace
+{
+
+void print_usage()
+{
+    std::cout << "Usage : floaty_bench [--lines <count>]... [--directive-free <count>]... [--iterations <count>]\n";
+    std::cout << "                     [--seed <seed>] [--json <file>]\n";
+    std::cout << "                     [--baseline <file> [--tolerance <fraction>] [--memory-tolerance <fraction>]\n";
+    std::cout << "                      [--noise-floor <ms>]]\n";
+    std::cout << "        floaty_bench --emit <dir> [--lines <count>] [--directive-free <count>] [--seed <seed>]\n";
+    std::cout << "Assembles generated sources of about <count> lines (default 1000, 10000 and 100000, and 100000\n";
+    std::cout << "without directives) and prints the lines/s and MB/s of each stage, from the median of the\n";
+    std::cout << "iterations. A --directive-free source has no #include, #define or macro, the preprocessor\n";
+    std::cout << "takes it without Wave. --emit writes the sources to <dir> instead. --json writes the results,\n";
+    std::cout << "which can serve as the --baseline of a later run :\n";
+    std::cout << "a stage then fails if its median time relative to the calibration workload run next to it got\n";
+    std::cout << "worse by more than <fraction> (default 0.3) and by more than the noise floor (default 0.05 ms),\n";
+    std::cout << "the peak memory if it grew by more than its own fraction (0.3).\n";
+}
+
+struct GateOptions
+{
+    double tolerance { 0.3 };
+    double memory_tolerance { 0.3 };
+    double noise_floor_ms { 0.05 };
+};
+
+struct StageResult
+{
+    std::string name;
+    // median of the runs
+    double ms;
+    // median of the runs of the stage time over the calibration time measured just before it
+    double per_calibration;
+};
+
+struct WorkloadResult
+{
+    std::string name;
+    uint32_t seed;
+    size_t lines;
+    size_t bytes;
+    size_t iterations;
+    // per run, the last one is "total"
+    std::vector<StageResult> stages;
+    // of the whole process so far
+    long peak_rss_kb;
+    // median time of the calibration workload run before each iteration, see calibrate()
+    double calibration_ms;
+};
+
+void emit(const floaty::Corpus& corpus, const std::string& dir)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec)
+    {
+        floaty::io_error_throw("Could not create corpus directory", dir);
+    }
+
+    auto write = [&dir](const std::string& name, const std::string& contents)
+    {
+        const std::string filename = dir + "/" + name;
+        std::ofstream stream(filename, std::ios::trunc | std::ios::binary);
+        stream << contents;
+        if (!stream)
+        {
+            floaty::io_error_throw("Could not write corpus file", filename);
+        }
+    };
+
+    write(corpus.main_name, corpus.main);
+    for (const auto& include : corpus.includes)
+    {
+        write(include.first, include.second);
+    }
+    std::cout << dir << "/" << corpus.main_name << " : " << corpus.lines << " lines, " << corpus.bytes << " bytes\n";
+}
+
+// Times a fixed mix of sorting, hashing and string building, the kind of work the assembler does.
+// Stage times are compared to the baseline relative to it, so that a machine that is slower overall, or busy
+// for a while, doesn't show up as a regression of every stage.
+double calibrate(int runs)
+{
+    std::mt19937 rng(42);
+    std::vector<std::string> words(20000);
+    for (auto& word : words)
+    {
+        word = "label_" + std::to_string(rng() % 100000);
+    }
+
+    double best_ms = std::numeric_limits<double>::max();
+    for (int run { 0 }; run < runs; ++run)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        auto sorted = words;
+        std::sort(sorted.begin(), sorted.end());
+        std::unordered_map<std::string, size_t> index;
+        for (size_t i { 0 }; i < sorted.size(); ++i)
+        {
+            index[sorted[i]] = i;
+        }
+        size_t checksum { 0 };
+        for (const auto& word : words)
+        {
+            checksum += index[word];
+        }
+        volatile size_t sink = checksum;
+        (void)sink;
+
+        best_ms = std::min(best_ms, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best_ms;
+}
+
+double median(std::vector<double> values)
+{
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    const size_t middle = values.size() / 2;
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+long peak_rss_kb()
+{
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void print_row(const std::string& stage, double ms, const WorkloadResult& result)
+{
+    const double seconds = ms / 1e3;
+    const double lines_per_s = seconds > 0 ? result.lines / seconds : 0;
+    const double mb_per_s = seconds > 0 ? result.bytes / seconds / 1e6 : 0;
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-20s %12.3f %14.0f %10.2f\n", stage.c_str(), ms, lines_per_s, mb_per_s);
+    std::cout << line;
+}
+
+// Returns nothing if the corpus doesn't assemble
+std::optional<WorkloadResult> bench(const floaty::Corpus& corpus, uint32_t seed, size_t iterations)
+{
+    floaty::VirtualFileSystem includes;
+    for (const auto& include : corpus.includes)
+    {
+        includes.add_file(include.first, include.second);
+    }
+
+    floaty::AssembleOptions options;
+    options.filename = corpus.main_name;
+    options.includes = &includes;
+
+    // warm up, and make sure the generator and the assembler still agree
+    auto image = floaty::assemble_text(corpus.main, options);
+    if (!image.success())
+    {
+        std::cerr << corpus.main_name << " doesn't assemble : " << image.diagnostics.front().message << std::endl;
+        return {};
+    }
+
+    // every run of each stage, the last one is the total, and the calibration time just before each run : a
+    // single sample, even the fastest one, moves with whatever else the machine does at that moment
+    std::vector<std::vector<double>> stage_ms((size_t)floaty::Phase::Count + 1);
+    std::vector<double> calibration_ms;
+    std::vector<bool> ran((size_t)floaty::Phase::Count, false);
+    for (size_t i { 0 }; i < iterations; ++i)
+    {
+        calibration_ms.push_back(calibrate(1));
+
+        floaty::Profiler profiler;
+        floaty::Profiler::set_active(&profiler);
+        const auto start = std::chrono::steady_clock::now();
+        floaty::assemble_text(corpus.main, options);
+        const auto total = std::chrono::steady_clock::now() - start;
+        floaty::Profiler::set_active(nullptr);
+
+        for (size_t phase { 0 }; phase < (size_t)floaty::Phase::Count; ++phase)
+        {
+            auto stats = profiler.stats(floaty::Phase(phase));
+            ran[phase] = ran[phase] || stats.calls > 0;
+            stage_ms[phase].push_back(stats.wall_ns / 1e6);
+        }
+        stage_ms.back().push_back(std::chrono::duration<double, std::milli>(total).count());
+    }
+
+    auto stage_result = [&](const std::string& name, const std::vector<double>& runs)
+    {
+        std::vector<double> ratios(runs.size());
+        for (size_t i { 0 }; i < runs.size(); ++i)
+        {
+            ratios[i] = calibration_ms[i] > 0 ? runs[i] / calibration_ms[i] : 0;
+        }
+        return StageResult { name, median(runs), median(ratios) };
+    };
+
+    WorkloadResult result { corpus.main_name, seed, corpus.lines, corpus.bytes, iterations, {}, peak_rss_kb(),
+                            median(calibration_ms) };
+    for (size_t phase { 0 }; phase < (size_t)floaty::Phase::Count; ++phase)
+    {
+        if (ran[phase]) result.stages.push_back(stage_result(floaty::phase_name(floaty::Phase(phase)), stage_ms[phase]));
+    }
+    result.stages.push_back(stage_result("total", stage_ms.back()));
+
+    std::cout << corpus.main_name << " : " << corpus.lines << " lines, " << corpus.bytes << " bytes, "
+              << image.image.size() << " byte image, median of " << iterations << " iterations, peak RSS "
+              << result.peak_rss_kb << " KB\n";
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-20s %12s %14s %10s\n", "stage", "ms/run", "lines/s", "MB/s");
+    std::cout << line;
+    for (const auto& stage : result.stages)
+    {
+        print_row(stage.name, stage.ms, result);
+    }
+    std::cout << "\n";
+
+    return result;
+}
+
+void write_json(const std::vector<WorkloadResult>& results, const std::string& filename)
+{
+    std::ofstream stream(filename, std::ios::trunc);
+    stream << "{\n  \"workloads\": [";
+    for (size_t i { 0 }; i < results.size(); ++i)
+    {
+        const auto& result = results[i];
+        stream << (i ? ",\n" : "\n")
+               << "    {\"name\": \"" << result.name << "\", \"seed\": " << result.seed
+               << ", \"lines\": " << result.lines << ", \"bytes\": " << result.bytes
+               << ", \"iterations\": " << result.iterations << ", \"peak_rss_kb\": " << result.peak_rss_kb
+               << ", \"calibration_ms\": " << result.calibration_ms
+               << ",\n     \"stages_ms\": {";
+        for (size_t j { 0 }; j < result.stages.size(); ++j)
+        {
+            char ms[32];
+            std::snprintf(ms, sizeof(ms), "%.4f", result.stages[j].ms);
+            stream << (j ? ", " : "") << "\"" << result.stages[j].name << "\": " << ms;
+        }
+        stream << "},\n     \"stages_per_calibration\": {";
+        for (size_t j { 0 }; j < result.stages.size(); ++j)
+        {
+            char ratio[32];
+            std::snprintf(ratio, sizeof(ratio), "%.6f", result.stages[j].per_calibration);
+            stream << (j ? ", " : "") << "\"" << result.stages[j].name << "\": " << ratio;
+        }
+        stream << "}}";
+    }
+    stream << "\n  ]\n}\n";
+
+    if (!stream)
+    {
+        floaty::io_error_throw("Could not write results", filename);
+    }
+}
+
+// Prints how 'result' compares to the baseline, returns false if it regressed
+bool check_against_baseline(const WorkloadResult& result, const floaty::JsonValue& baseline, const GateOptions& gate)
+{
+    const floaty::JsonValue* reference { nullptr };
+    if (auto workloads = baseline.find("workloads"))
+    {
+        for (const auto& workload : workloads->array)
+        {
+            auto name = workload.find("name");
+            auto seed = workload.find("seed");
+            if (name && name->string == result.name && seed && seed->number == result.seed) reference = &workload;
+        }
+    }
+    if (!reference)
+    {
+        std::cout << result.name << " : not in the baseline, nothing to compare\n\n";
+        return true;
+    }
+
+    // the baseline times as they would be on this machine, as fast as it currently is
+    double speed_ratio { 1 };
+    if (auto base_calibration = reference->find("calibration_ms"))
+    {
+        if (base_calibration->number > 0) speed_ratio = result.calibration_ms / base_calibration->number;
+    }
+
+    bool passed = true;
+    char line[160];
+    std::cout << result.name << " against the baseline, tolerance " << gate.tolerance * 100
+              << "%, median times relative to the calibration workload, shown at its current "
+              << result.calibration_ms << " ms (" << speed_ratio << " times the baseline one)\n";
+    std::snprintf(line, sizeof(line), "%-20s %14s %14s %9s  %s\n", "stage", "baseline", "current", "change", "status");
+    std::cout << line;
+
+    auto compare = [&](const std::string& name, double base, double current, double tolerance, double floor,
+                       const char* unit)
+    {
+        const bool regressed = current > base * (1 + tolerance) && current - base > floor;
+        passed &= !regressed;
+        const double change = base > 0 ? (current - base) / base * 100 : 0;
+        std::snprintf(line, sizeof(line), "%-20s %11.3f %-2s %11.3f %-2s %+8.1f%%  %s\n", name.c_str(), base, unit,
+                      current, unit, change, regressed ? "REGRESSED" : "ok");
+        std::cout << line;
+    };
+
+    // the ratios of each run to the calibration just before it, a baseline from before they were recorded only has
+    // its times to scale
+    auto ratios = reference->find("stages_per_calibration");
+    auto stages = reference->find("stages_ms");
+    for (const auto& stage : result.stages)
+    {
+        if (auto base = ratios ? ratios->find(stage.name) : nullptr)
+        {
+            compare(stage.name, base->number * result.calibration_ms, stage.per_calibration * result.calibration_ms,
+                    gate.tolerance, gate.noise_floor_ms, "ms");
+        }
+        else if (auto base = stages ? stages->find(stage.name) : nullptr)
+        {
+            compare(stage.name, base->number * speed_ratio, stage.ms, gate.tolerance, gate.noise_floor_ms, "ms");
+        }
+    }
+    if (auto base = reference->find("peak_rss_kb"))
+    {
+        compare("peak_rss", base->number / 1024, result.peak_rss_kb / 1024.0, gate.memory_tolerance, 0, "MB");
+    }
+    std::cout << (passed ? "PASSED" : "FAILED") << "\n\n";
+
+    return passed;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    // the seed is filled in once every option is read
+    std::vector<floaty::CorpusOptions> workloads;
+    size_t iterations { 0 };
+    uint32_t seed { 1 };
+    std::string emit_dir;
+    std::string json_file;
+    std::string baseline_file;
+    GateOptions gate;
+
+    try
+    {
+        for (int i { 1 }; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--lines" && i + 1 < argc)
+            {
+                workloads.push_back({std::stoul(argv[++i])});
+            }
+            else if (arg == "--directive-free" && i + 1 < argc)
+            {
+                workloads.push_back({std::stoul(argv[++i]), 1, false});
+            }
+            else if (arg == "--iterations" && i + 1 < argc)
+            {
+                iterations = std::stoul(argv[++i]);
+            }
+            else if (arg == "--seed" && i + 1 < argc)
+            {
+                seed = std::stoul(argv[++i]);
+            }
+            else if (arg == "--emit" && i + 1 < argc)
+            {
+                emit_dir = argv[++i];
+            }
+            else if (arg == "--json" && i + 1 < argc)
+            {
+                json_file = argv[++i];
+            }
+            else if (arg == "--baseline" && i + 1 < argc)
+            {
+                baseline_file = argv[++i];
+            }
+            else if (arg == "--tolerance" && i + 1 < argc)
+            {
+                gate.tolerance = std::stod(argv[++i]);
+            }
+            else if (arg == "--memory-tolerance" && i + 1 < argc)
+            {
+                gate.memory_tolerance = std::stod(argv[++i]);
+            }
+            else if (arg == "--noise-floor" && i + 1 < argc)
+            {
+                gate.noise_floor_ms = std::stod(argv[++i]);
+            }
+            else
+            {
+                print_usage();
+                return arg == "-h" || arg == "--help" ? 0 : -16;
+            }
+        }
+        if (workloads.empty())
+        {
+            workloads = emit_dir.empty() ? std::vector<floaty::CorpusOptions>{{1000}, {10000}, {100000}, {100000, 1, false}}
+                                         : std::vector<floaty::CorpusOptions>{{10000}};
+        }
+
+        std::optional<floaty::JsonValue> baseline;
+        if (!baseline_file.empty())
+        {
+            floaty::SourceFile file(baseline_file);
+            baseline = floaty::parse_json(file.view());
+        }
+
+        std::vector<WorkloadResult> results;
+        bool passed = true;
+        for (auto& workload : workloads)
+        {
+            workload.seed = seed;
+            const size_t lines = workload.lines;
+            auto corpus = floaty::generate_corpus(workload);
+            if (!emit_dir.empty())
+            {
+                emit(corpus, emit_dir);
+                continue;
+            }
+
+            // about a million lines per size unless told otherwise, at least five runs for a meaningful median
+            const size_t runs = iterations ? iterations : std::max<size_t>(5, 1000000 / std::max<size_t>(lines, 1) / 10);
+            auto result = bench(corpus, seed, runs);
+            if (!result) return -1;
+
+            if (baseline) passed &= check_against_baseline(*result, *baseline, gate);
+            results.push_back(std::move(*result));
+        }
+
+        if (!json_file.empty()) write_json(results, json_file);
+        return passed ? 0 : 1;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return -16;
+    }
+}
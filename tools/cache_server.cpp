@@ -0,0 +1,215 @@
+/*
+cache_server.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+// Reference server for the shared image cache (see remote_cache.hpp for the protocol).
+// Images are kept in a BuildCache directory, so the server can be restarted without losing them.
+
+#include <sys/socket.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
+
+#include <iostream>
+#include <thread>
+
+#include "build_cache.hpp"
+#include "source_file.hpp"
+#include "socket_stream.hpp"
+#include "stl_utils.hpp"
+
+namespace
+{
+
+std::string response(const std::string& status, std::string_view body = {})
+{
+    std::string message = "HTTP/1.1 " + status + "\r\n"
+            "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    message.append(body.data(), body.size());
+    return message;
+}
+
+bool is_valid_key(std::string_view key)
+{
+    return key.size() == 40 && key.find_first_not_of("0123456789abcdef") == std::string_view::npos;
+}
+
+// Returns false when the connection must be closed
+bool handle_request(floaty::SocketStream& conn, floaty::BuildCache& cache)
+{
+    auto request_line = conn.read_line();
+    if (!request_line) return false;
+
+    // "<method> <path> HTTP/1.1"
+    auto fields = floaty::split(*request_line, " ");
+    if (fields.size() != 3)
+    {
+        conn.write_all(response("400 Bad Request"));
+        return false;
+    }
+
+    size_t content_length { 0 };
+    bool keep_alive { true };
+    while (true)
+    {
+        auto header = conn.read_line();
+        if (!header) return false;
+        if (header->empty()) break;
+
+        auto colon = header->find(':');
+        if (colon == std::string::npos) continue;
+        auto name = floaty::to_lower(header->substr(0, colon));
+        auto value = floaty::trim(std::string_view(*header).substr(colon + 1));
+        if (name == "content-length")
+        {
+            content_length = std::strtoul(std::string(value).c_str(), nullptr, 10);
+        }
+        else if (name == "connection" && floaty::to_lower(std::string(value)) == "close")
+        {
+            keep_alive = false;
+        }
+    }
+
+    auto body = conn.read_bytes(content_length);
+    if (!body) return false;
+
+    const auto method = fields[0];
+    auto path = fields[1];
+
+    if (method == "GET" && path == "/stats")
+    {
+        auto stats = cache.stats();
+        std::string text = "hits " + std::to_string(stats.hits) + "\nmisses " + std::to_string(stats.misses)
+                + "\nsize " + std::to_string(stats.size) + "\n";
+        return conn.write_all(response("200 OK", text)) && keep_alive;
+    }
+
+    constexpr std::string_view prefix = "/cache/";
+    if (path.compare(0, prefix.size(), prefix) != 0 || !is_valid_key(path.substr(prefix.size())))
+    {
+        return conn.write_all(response("404 Not Found")) && keep_alive;
+    }
+    const std::string key { path.substr(prefix.size()) };
+
+    if (method == "GET")
+    {
+        auto image = cache.lookup(key);
+        if (!image)
+        {
+            return conn.write_all(response("404 Not Found")) && keep_alive;
+        }
+        return conn.write_all(response("200 OK", std::string_view((const char*)image->data(), image->size())))
+                && keep_alive;
+    }
+    else if (method == "PUT")
+    {
+        try
+        {
+            cache.store(key, gsl::span<const uint8_t>((const uint8_t*)body->data(), body->size()));
+        }
+        catch (const floaty::io_error& e)
+        {
+            return conn.write_all(response("500 Internal Server Error", e.what())) && keep_alive;
+        }
+        return conn.write_all(response("201 Created")) && keep_alive;
+    }
+
+    return conn.write_all(response("405 Method Not Allowed")) && keep_alive;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::string listen_address;
+    std::string directory;
+    uint64_t max_size { 1ull << 30 };
+
+    try
+    {
+        for (int i { 1 }; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--listen" && i + 1 < argc)
+            {
+                listen_address = argv[++i];
+            }
+            else if (arg == "--dir" && i + 1 < argc)
+            {
+                directory = argv[++i];
+            }
+            else if (arg == "--size" && i + 1 < argc)
+            {
+                max_size = floaty::parse_cache_size(argv[++i]);
+            }
+            else
+            {
+                std::cout << "Usage : floaty_cache_server --listen <unix:path|http://host:port> --dir <cache_dir> [--size <size>]\n";
+                return arg == "-h" || arg == "--help" ? 0 : -16;
+            }
+        }
+
+        if (listen_address.empty() || directory.empty())
+        {
+            std::cerr << "--listen and --dir are required" << std::endl;
+            return -16;
+        }
+
+        floaty::BuildCache cache(directory, max_size);
+
+        auto endpoint = floaty::parse_endpoint(listen_address);
+        int listen_fd = floaty::listen_on(endpoint);
+        if (listen_fd < 0)
+        {
+            std::cerr << "Could not listen on " << listen_address << " : " << std::strerror(errno) << std::endl;
+            return -16;
+        }
+
+        std::signal(SIGPIPE, SIG_IGN);
+        std::cout << "Serving " << directory << " on " << listen_address << std::endl;
+
+        while (true)
+        {
+            int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                std::cerr << "accept failed : " << std::strerror(errno) << std::endl;
+                return -16;
+            }
+
+            std::thread([fd, &cache]
+            {
+                floaty::SocketStream conn(fd);
+                while (handle_request(conn, cache)) {}
+            }).detach();
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Fatal exception : " << e.what() << std::endl;
+        return -4;
+    }
+}
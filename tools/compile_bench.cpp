@@ -0,0 +1,106 @@
+/*
+compile_bench.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+// Measures how long the compiler takes on src/assembler.cpp with the flat opcode table (opcode_table.hpp) and with
+// FLOATY_OPCODE_TEMPLATES, which instantiates the Opcode templates of opcode_def.hpp for every opcode instead.
+// The compiler and flags are the ones CMake configured, see CMakeLists.txt.
+
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <string>
+
+namespace
+{
+
+void print_usage()
+{
+    std::cout << "Usage : floaty_compile_bench [--runs <count>]\n";
+    std::cout << "Compiles src/assembler.cpp <count> times (default 3) in each opcode table mode and prints the\n";
+    std::cout << "best time of each.\n";
+}
+
+// Best wall time of 'runs' compilations, in seconds, or a negative value if the compiler failed
+double time_compile(const std::string& extra_flags, int runs)
+{
+    const std::string command = std::string(FLOATY_CXX) + " " + FLOATY_CXX_FLAGS + " " + FLOATY_INCLUDE_FLAGS + " "
+            + extra_flags + " -c " + FLOATY_SOURCE_DIR + "/src/assembler.cpp -o /dev/null";
+
+    double best = std::numeric_limits<double>::max();
+    for (int run { 0 }; run < runs; ++run)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const int status = std::system(command.c_str());
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (status == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            std::cerr << "Compilation failed : " << command << std::endl;
+            return -1;
+        }
+        best = std::min(best, seconds);
+    }
+    return best;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    int runs { 3 };
+
+    for (int i { 1 }; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+        {
+            runs = std::max(1, std::stoi(argv[++i]));
+        }
+        else
+        {
+            print_usage();
+            return arg == "-h" || arg == "--help" ? 0 : -16;
+        }
+    }
+
+    const double table = time_compile("", runs);
+    if (table < 0) return 1;
+    const double templates = time_compile("-DFLOATY_OPCODE_TEMPLATES", runs);
+    if (templates < 0) return 1;
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-24s %10s\n", "assembler.cpp", "best (s)");
+    std::cout << line;
+    std::snprintf(line, sizeof(line), "%-24s %10.2f\n", "opcode templates", templates);
+    std::cout << line;
+    std::snprintf(line, sizeof(line), "%-24s %10.2f   %.1fx faster\n", "flat opcode table", table, templates / table);
+    std::cout << line;
+
+    return 0;
+}
@@ -0,0 +1,335 @@
+/*
+corpus.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "corpus.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "floatyasm.hpp"
+#include "stl_utils.hpp"
+
+namespace floaty
+{
+
+namespace
+{
+
+const char* const opcode_formats[] =
+{
+#define OPCODE_DEF(pattern, fmt) fmt,
+#include "opcodes.def"
+};
+
+// constants and macro of the definitions header, used in place of immediates and instructions
+constexpr size_t constant_count { 16 };
+constexpr const char defs_name[] = "defs.inc";
+constexpr size_t routine_files { 8 };
+
+class Generator
+{
+public:
+    Generator(uint32_t seed, bool directives)
+        : rng(seed), directives(directives)
+    {
+        // keep the forms the assembler accepts, so that the corpus assembles whatever opcodes.def holds
+        for (const char* format : opcode_formats)
+        {
+            auto line = instantiate(format, "target");
+            if (assemble_text("target: NOP\n" + line + "\n").success())
+            {
+                forms.emplace_back(format);
+            }
+        }
+    }
+
+    // Generates about 'count' lines, labels are prefixed with 'prefix' so that files don't clash.
+    // pre_preprocess only strips the ';' comments of the main source, include files use '//'.
+    std::string generate(size_t count, const std::string& prefix, const char* comment_start)
+    {
+        std::string text;
+        label_prefix = prefix;
+        comment_marker = comment_start;
+        next_label = 0;
+        highest_reference = 0;
+
+        for (size_t line { 0 }; line < count; ++line)
+        {
+            // never last, the label would stick to the first line of whatever follows
+            if (line % 16 == 0 && line + 1 < count)
+            {
+                text += label(next_label++) + ":\n";
+                continue;
+            }
+
+            const auto choice = uniform(100);
+            if (choice < 80) text += instruction();
+            else if (choice < 86) text += data();
+            else if (choice < 89) text += dup();
+            else if (choice < 91) text += seek();
+            else if (choice < 94) text += directives ? macro() : instruction();
+            else text += comment();
+            text += '\n';
+        }
+
+        // define the labels the last lines referenced ahead
+        while (next_label <= highest_reference)
+        {
+            text += label(next_label++) + ": NOP\n";
+            bytes += 3;
+        }
+
+        return text;
+    }
+
+    std::string definitions()
+    {
+        std::string text = "// constants and macros shared by the corpus\n";
+        for (size_t i { 0 }; i < constant_count; ++i)
+        {
+            text += "#define CONST_" + std::to_string(i) + " " + std::to_string(uniform(256)) + "\n";
+        }
+        text += "#define LOAD_PAIR(a, b, value) LD a, value\n";
+        text += "#define SET_FLAG(reg) LD reg, 1\n";
+        return text;
+    }
+
+    size_t form_count() const
+    {
+        return forms.size();
+    }
+
+private:
+    size_t uniform(size_t bound)
+    {
+        return std::uniform_int_distribution<size_t>(0, bound - 1)(rng);
+    }
+
+    std::string reg_digit()
+    {
+        return std::to_string(uniform(10));
+    }
+
+    std::string label(size_t index) const
+    {
+        return label_prefix + std::to_string(index);
+    }
+
+    // A label of the next few blocks, most references in real programs go forward
+    std::string forward_reference()
+    {
+        if (next_label > 0 && uniform(4) == 0) return label(uniform(next_label));
+
+        const size_t target = next_label + uniform(4);
+        highest_reference = std::max(highest_reference, target);
+        return label(target);
+    }
+
+    std::string immediate()
+    {
+        if (uniform(8) == 0 && directives) return "CONST_" + std::to_string(uniform(constant_count));
+        return uniform(2) ? std::to_string(uniform(256)) : "0x" + to_hex(uniform(256));
+    }
+
+    static std::string to_hex(size_t value)
+    {
+        const char digits[] = "0123456789abcdef";
+        std::string result;
+        do
+        {
+            result.insert(result.begin(), digits[value % 16]);
+            value /= 16;
+        } while (value);
+        return result;
+    }
+
+    std::string operand(std::string_view format, const std::string& address)
+    {
+        if (format.size() == 1) return immediate();
+        if (format == "addr") return address;
+        if (format == "[addr]") return "[" + address + "]";
+        if (format == "SP" || format == "ST" || format == "DT") return std::string(format);
+        if (format.size() == 5 && format[1] == '(') return std::string(format.substr(0, 3)) + reg_digit() + ")";
+        if (format.size() == 4 && format[0] == '[') return "[I" + reg_digit() + "]";
+        if (format.size() == 6 && format[0] == '[') return "[I" + reg_digit() + "+" + std::to_string(uniform(128)) + "]";
+        if (format.size() == 9 && format[0] == '[')
+        {
+            return "[I" + reg_digit() + "+B" + reg_digit() + "+" + std::to_string(uniform(16)) + "]";
+        }
+        return format[0] + reg_digit();
+    }
+
+    // The instruction 'format' describes, with random operands
+    std::string instantiate(std::string_view format, const std::string& address)
+    {
+        auto space = format.find(' ');
+        std::string line(format.substr(0, space));
+        if (space == std::string_view::npos) return line;
+
+        auto operands = split(format.substr(space + 1), ",");
+        for (size_t i { 0 }; i < operands.size(); ++i)
+        {
+            line += (i ? ", " : " ") + operand(trim(operands[i]), address);
+        }
+        return line;
+    }
+
+    std::string instruction()
+    {
+        bytes += 3;
+        return instantiate(forms[uniform(forms.size())], forward_reference());
+    }
+
+    std::string data()
+    {
+        const size_t count = 1 + uniform(8);
+        switch (uniform(4))
+        {
+            case 0:
+            {
+                std::string line = "DB";
+                for (size_t i { 0 }; i < count; ++i) line += (i ? ", " : " ") + std::to_string(uniform(256));
+                bytes += count;
+                return line;
+            }
+            case 1:
+            {
+                std::string line = "DW";
+                for (size_t i { 0 }; i < count; ++i) line += (i ? ", 0x" : " 0x") + to_hex(uniform(0x10000));
+                bytes += count * 2;
+                return line;
+            }
+            case 2:
+            {
+                std::string line = "DD";
+                for (size_t i { 0 }; i < count; ++i) line += (i ? ", " : " ") + std::to_string(uniform(1u << 31));
+                bytes += count * 4;
+                return line;
+            }
+            default:
+            {
+                static const char* const words[] = {"score", "lives", "GAME_OVER", "level", "hello_world", "pause"};
+                std::string word = words[uniform(6)];
+                bytes += word.size();
+                return "DS \"" + word + "\"";
+            }
+        }
+    }
+
+    std::string dup()
+    {
+        const size_t count = 2 + uniform(7);
+        bytes += count * 3;
+        return "DUP " + std::to_string(count) + " " + (uniform(2) ? "NOP" : "LD B" + reg_digit() + ", " + immediate());
+    }
+
+    std::string seek()
+    {
+        // up to the next 256 byte boundary, past a small gap
+        bytes = (bytes + 64 + 255) / 256 * 256;
+        return "SEEK 0x" + to_hex(bytes);
+    }
+
+    std::string macro()
+    {
+        bytes += 3;
+        if (uniform(2)) return "SET_FLAG(B" + reg_digit() + ")";
+        return "LOAD_PAIR(B" + reg_digit() + ", B" + reg_digit() + ", CONST_" + std::to_string(uniform(constant_count)) + ")";
+    }
+
+    std::string comment()
+    {
+        if (uniform(2)) return comment_marker + " block " + std::to_string(next_label) + " of " + label_prefix;
+
+        bytes += 3;
+        return "NOP " + comment_marker + " padding";
+    }
+
+    std::mt19937 rng;
+    bool directives;
+    std::vector<std::string_view> forms;
+    // bytes the program has emitted so far, SEEK can only go forward
+    size_t bytes { 0 };
+    std::string label_prefix;
+    std::string comment_marker;
+    size_t next_label { 0 };
+    size_t highest_reference { 0 };
+};
+
+size_t count_lines(const std::string& text)
+{
+    return std::count(text.begin(), text.end(), '\n');
+}
+
+}
+
+Corpus generate_corpus(const CorpusOptions &options)
+{
+    Generator generator(options.seed, options.directives);
+    Corpus corpus;
+    if (!options.directives)
+    {
+        corpus.main_name = "corpus_" + std::to_string(options.lines) + "_directive_free.asm";
+        corpus.main = generator.generate(std::max<size_t>(options.lines, 1), "main_", ";");
+        corpus.lines = count_lines(corpus.main);
+        corpus.bytes = corpus.main.size();
+        return corpus;
+    }
+    corpus.main_name = "corpus_" + std::to_string(options.lines) + ".asm";
+
+    corpus.includes[defs_name] = generator.definitions();
+    const size_t header_lines = count_lines(corpus.includes[defs_name]);
+
+    // a tenth of the program is spread over routine files, included one after the other in the middle of main
+    const size_t body_lines = options.lines > header_lines ? options.lines - header_lines : 1;
+    const size_t routine_lines = body_lines / 10 / routine_files;
+    const size_t main_lines = body_lines - routine_lines * routine_files;
+
+    corpus.main = "#include \"" + std::string(defs_name) + "\"\n";
+    corpus.main += generator.generate(main_lines / 2, "main_a_", ";");
+    if (routine_lines > 0)
+    {
+        for (size_t i { 0 }; i < routine_files; ++i)
+        {
+            const std::string name = "routine_" + std::to_string(i) + ".inc";
+            corpus.includes[name] = generator.generate(routine_lines, "routine" + std::to_string(i) + "_", "//");
+            corpus.main += "#include \"" + name + "\"\n";
+        }
+    }
+    corpus.main += generator.generate(main_lines - main_lines / 2, "main_b_", ";");
+
+    corpus.lines = count_lines(corpus.main);
+    corpus.bytes = corpus.main.size();
+    for (const auto& include : corpus.includes)
+    {
+        corpus.lines += count_lines(include.second);
+        corpus.bytes += include.second.size();
+    }
+
+    return corpus;
+}
+
+}
@@ -0,0 +1,68 @@
+/*
+corpus.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef CORPUS_HPP
+#define CORPUS_HPP
+
+#include <cstdint>
+
+#include <map>
+#include <string>
+
+namespace floaty
+{
+
+struct CorpusOptions
+{
+    // lines of the main source and its include files together, approximately
+    size_t lines { 10000 };
+    uint32_t seed { 1 };
+    // false for a single source without #include, #define or macros, which the preprocessor takes without Wave
+    bool directives { true };
+};
+
+// A synthetic program : the main source and the files it includes
+struct Corpus
+{
+    std::string main_name;
+    std::string main;
+    // by name, as written in the #include directives
+    std::map<std::string, std::string> includes;
+
+    size_t lines { 0 };
+    size_t bytes { 0 };
+};
+
+/*
+Generates a program that mixes every OPCODE_DEF form the assembler accepts, with labels every few lines and
+forward references to them, DUP, SEEK, DB/DW/DD/DS, ';' comments, and #include/#define usage : constants and a
+function-like macro from a definitions header, and routines kept in separate include files.
+Without directives, the constants and macros are replaced by plain immediates and instructions.
+The same options always give the same corpus.
+*/
+Corpus generate_corpus(const CorpusOptions& options);
+
+}
+
+#endif // CORPUS_HPP
@@ -0,0 +1,167 @@
+/*
+json_reader.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+#include "json_reader.hpp"
+
+#include <cctype>
+#include <cstdlib>
+
+namespace floaty
+{
+
+namespace
+{
+
+class JsonParser
+{
+public:
+    explicit JsonParser(std::string_view text)
+        : text(text)
+    {}
+
+    JsonValue parse_document()
+    {
+        auto value = parse_value();
+        skip_whitespace();
+        if (pos != text.size()) fail("trailing characters");
+        return value;
+    }
+
+private:
+    [[noreturn]] void fail(const std::string& why) const
+    {
+        throw json_error("JSON error : " + why + " at offset " + std::to_string(pos));
+    }
+
+    void skip_whitespace()
+    {
+        while (pos < text.size() && isspace((unsigned char)text[pos])) ++pos;
+    }
+
+    bool consume(char c)
+    {
+        skip_whitespace();
+        if (pos < text.size() && text[pos] == c)
+        {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+
+    void expect(char c)
+    {
+        if (!consume(c)) fail(std::string("expected '") + c + "'");
+    }
+
+    bool consume_word(std::string_view word)
+    {
+        if (text.substr(pos, word.size()) != word) return false;
+        pos += word.size();
+        return true;
+    }
+
+    std::string parse_string()
+    {
+        expect('"');
+        std::string result;
+        while (pos < text.size() && text[pos] != '"')
+        {
+            if (text[pos] == '\\' && pos + 1 < text.size()) ++pos;
+            result += text[pos++];
+        }
+        expect('"');
+        return result;
+    }
+
+    JsonValue parse_value()
+    {
+        skip_whitespace();
+        if (pos >= text.size()) fail("unexpected end");
+
+        JsonValue value;
+        const char c = text[pos];
+        if (c == '{')
+        {
+            value.type = JsonValue::Type::Object;
+            ++pos;
+            if (consume('}')) return value;
+            do
+            {
+                skip_whitespace();
+                auto key = parse_string();
+                expect(':');
+                value.object.emplace_back(std::move(key), parse_value());
+            } while (consume(','));
+            expect('}');
+        }
+        else if (c == '[')
+        {
+            value.type = JsonValue::Type::Array;
+            ++pos;
+            if (consume(']')) return value;
+            do
+            {
+                value.array.push_back(parse_value());
+            } while (consume(','));
+            expect(']');
+        }
+        else if (c == '"')
+        {
+            value.type = JsonValue::Type::String;
+            value.string = parse_string();
+        }
+        else if (consume_word("true") || consume_word("false"))
+        {
+            value.type = JsonValue::Type::Bool;
+            value.boolean = c == 't';
+        }
+        else if (consume_word("null"))
+        {
+        }
+        else
+        {
+            const std::string number(text.substr(pos, 32));
+            char* end;
+            value.type = JsonValue::Type::Number;
+            value.number = std::strtod(number.c_str(), &end);
+            if (end == number.c_str()) fail("unexpected character");
+            pos += end - number.c_str();
+        }
+        return value;
+    }
+
+    std::string_view text;
+    size_t pos { 0 };
+};
+
+}
+
+JsonValue parse_json(std::string_view text)
+{
+    return JsonParser(text).parse_document();
+}
+
+}
@@ -0,0 +1,78 @@
+/*
+json_reader.hpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+#ifndef JSON_READER_HPP
+#define JSON_READER_HPP
+
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace floaty
+{
+
+struct json_error : std::runtime_error
+{
+        using std::runtime_error::runtime_error;
+};
+
+// Just enough JSON for the files the tools write themselves : no escapes beyond \" and \\, numbers as doubles
+struct JsonValue
+{
+    enum class Type
+    {
+        Null,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object
+    };
+
+    // Null if this isn't an object or has no such member
+    const JsonValue* find(std::string_view key) const
+    {
+        for (const auto& member : object)
+        {
+            if (member.first == key) return &member.second;
+        }
+        return nullptr;
+    }
+
+    Type type { Type::Null };
+    bool boolean { false };
+    double number { 0 };
+    std::string string;
+    std::vector<JsonValue> array;
+    std::vector<std::pair<std::string, JsonValue>> object;
+};
+
+// Throws json_error on malformed input
+JsonValue parse_json(std::string_view text);
+
+}
+
+#endif // JSON_READER_HPP
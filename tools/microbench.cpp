@@ -0,0 +1,242 @@
+/*
+microbench.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+// Micro-benchmarks of the operand classifiers (operand.hpp) and string utilities (stl_utils.hpp).
+// The tokens come from a generated corpus (see corpus.hpp), so each helper sees the mix of operands, mnemonics
+// and lines of a real program.
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "corpus.hpp"
+#include "floatyasm.hpp"
+#include "driver.hpp"
+#include "operand.hpp"
+#include "parser.hpp"
+#include "stl_utils.hpp"
+
+namespace
+{
+
+void print_usage()
+{
+    std::cout << "Usage : floaty_microbench [--filter <substring>] [--min-time <ms>] [--lines <count>] [--seed <seed>]\n";
+    std::cout << "Runs every benchmark whose name contains <substring> for at least <ms> (default 200) and prints\n";
+    std::cout << "the time per token. The tokens come from a generated corpus of <count> lines (default 20000).\n";
+}
+
+// Parses the whole of 'value' as a non-negative number, throws std::invalid_argument or std::out_of_range otherwise
+unsigned long parse_number(const std::string& value)
+{
+    // stoul would wrap "-1" around
+    if (value.empty() || value[0] == '-') throw std::invalid_argument(value);
+
+    size_t parsed { 0 };
+    const unsigned long number = std::stoul(value, &parsed);
+    if (parsed != value.size()) throw std::invalid_argument(value);
+    return number;
+}
+
+struct Tokens
+{
+    // instruction arguments, as the assembler sees them
+    std::vector<std::string> operands;
+    // mnemonics as written in the source, before they are upper-cased
+    std::vector<std::string> mnemonics;
+    // preprocessed lines, untrimmed
+    std::vector<std::string> lines;
+};
+
+Tokens collect_tokens(const floaty::Corpus& corpus)
+{
+    floaty::VirtualFileSystem includes;
+    for (const auto& include : corpus.includes)
+    {
+        includes.add_file(include.first, include.second);
+    }
+    floaty::PreprocessOptions options;
+    options.loader = &includes;
+    const auto preprocessed = floaty::preprocess_source(corpus.main, corpus.main_name, options);
+
+    Tokens tokens;
+    for (auto line : floaty::split(preprocessed, "\n", false, false))
+    {
+        tokens.lines.emplace_back(line);
+        auto fields = floaty::split(floaty::trim(line), " ,");
+        if (fields.empty() || fields[0].front() == '#' || fields[0].back() == ':') continue;
+        tokens.mnemonics.emplace_back(fields[0]);
+    }
+    for (const auto& directive : floaty::parse(preprocessed, corpus.main_name))
+    {
+        const auto& ins = std::get<floaty::Instruction>(directive);
+        tokens.operands.insert(tokens.operands.end(), ins.arguments.begin(), ins.arguments.end());
+    }
+    return tokens;
+}
+
+struct Benchmark
+{
+    const char* name;
+    const std::vector<std::string>* input;
+    // returns a value depending on every result, so that the calls can't be optimized away
+    std::function<size_t(const std::string&)> run;
+};
+
+void run_benchmark(const Benchmark& benchmark, std::chrono::nanoseconds min_time)
+{
+    const auto& input = *benchmark.input;
+    size_t checksum { 0 };
+    size_t tokens { 0 };
+
+    const auto start = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::nanoseconds::zero();
+    // at least one pass, so that there is a time per token to report
+    do
+    {
+        for (const auto& token : input)
+        {
+            checksum += benchmark.run(token);
+        }
+        tokens += input.size();
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < min_time);
+
+    const double ns_per_token = double(elapsed.count()) / tokens;
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-44s %10.2f %12.2f %12zu\n", benchmark.name, ns_per_token,
+                  1e3 / ns_per_token, checksum % 1000);
+    std::cout << line;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    std::string filter;
+    long min_time_ms { 200 };
+    size_t lines { 20000 };
+    uint32_t seed { 1 };
+
+    for (int i { 1 }; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        try
+        {
+            if (arg == "--filter" && i + 1 < argc)
+            {
+                filter = argv[++i];
+            }
+            else if (arg == "--min-time" && i + 1 < argc)
+            {
+                // "0.5" would otherwise silently become 0
+                const unsigned long value = parse_number(argv[++i]);
+                if (value == 0 || value > (unsigned long)std::numeric_limits<long>::max())
+                {
+                    throw std::out_of_range(argv[i]);
+                }
+                min_time_ms = value;
+            }
+            else if (arg == "--lines" && i + 1 < argc)
+            {
+                lines = parse_number(argv[++i]);
+            }
+            else if (arg == "--seed" && i + 1 < argc)
+            {
+                const unsigned long value = parse_number(argv[++i]);
+                if (value > std::numeric_limits<uint32_t>::max()) throw std::out_of_range(argv[i]);
+                seed = value;
+            }
+            else
+            {
+                print_usage();
+                return arg == "-h" || arg == "--help" ? 0 : -16;
+            }
+        }
+        catch (const std::logic_error&)
+        {
+            std::cerr << "Invalid value '" << argv[i] << "' for " << arg << std::endl;
+            print_usage();
+            return -16;
+        }
+    }
+
+    const auto tokens = collect_tokens(floaty::generate_corpus({lines, seed}));
+    const auto* operands = &tokens.operands;
+    const auto* mnemonics = &tokens.mnemonics;
+    const auto* source_lines = &tokens.lines;
+
+    using namespace floaty;
+    const Benchmark benchmarks[] =
+    {
+        {"operand/is_number", operands, [](const std::string& s) { return size_t(is_number(s)); }},
+        {"operand/is_immediate", operands, [](const std::string& s) { return size_t(is_immediate(s)); }},
+        {"operand/is_signed_immediate", operands, [](const std::string& s) { return size_t(is_signed_immediate(s)); }},
+        {"operand/is_address", operands, [](const std::string& s) { return size_t(is_address(s)); }},
+        {"operand/is_identifier", operands, [](const std::string& s) { return size_t(is_identifier(s)); }},
+        {"operand/is_reg", operands, [](const std::string& s) { return size_t(is_reg(s)); }},
+        {"operand/is_reg_b", operands, [](const std::string& s) { return size_t(is_reg(s, 'B')); }},
+        {"operand/is_indir_reg_b", operands, [](const std::string& s) { return size_t(is_indir_reg(s, 'B')); }},
+        {"operand/is_indir_address", operands, [](const std::string& s) { return size_t(is_indir_address(s)); }},
+        {"operand/is_indir_ireg_plus_n", operands, [](const std::string& s) { return size_t(is_indir_ireg_plus_n(s)); }},
+        {"operand/is_indir_address_plus_n", operands, [](const std::string& s) { return size_t(is_indir_address_plus_n(s)); }},
+        {"operand/is_indir_address_plus_breg_plus_n", operands, [](const std::string& s)
+        {
+            return size_t(is_indir_address_plus_breg_plus_n(s));
+        }},
+        {"operand/has_indirect_offset", operands, [](const std::string& s)
+        {
+            return size_t(is_indir_address_plus_n(s) && has_indirect_offset(s));
+        }},
+        {"string/to_upper", mnemonics, [](const std::string& s) { return to_upper(s).size(); }},
+        {"string/to_lower", mnemonics, [](const std::string& s) { return to_lower(s).size(); }},
+        {"string/trim", source_lines, [](const std::string& s) { return trim(s).size(); }},
+        {"string/split", source_lines, [](const std::string& s) { return split(trim(s), " ,").size(); }},
+        {"string/split_reused", source_lines, [](const std::string& s)
+        {
+            static std::vector<std::string_view> fields;
+            split(trim(s), fields, " ,");
+            return fields.size();
+        }},
+    };
+
+    std::cout << operands->size() << " operands, " << mnemonics->size() << " mnemonics, "
+              << source_lines->size() << " lines\n";
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-44s %10s %12s %12s\n", "benchmark", "ns/token", "Mtokens/s", "checksum");
+    std::cout << line;
+    for (const auto& benchmark : benchmarks)
+    {
+        if (std::string_view(benchmark.name).find(filter) == std::string_view::npos) continue;
+        run_benchmark(benchmark, std::chrono::milliseconds(min_time_ms));
+    }
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+# Checks that --pipeline gives the same image and the same errors as the serial path, run by CTest as
+#     cmake -DASSEMBLER=<FloatyChipAsm> -DBENCH=<floaty_bench> -DWORK_DIR=<dir> -P pipeline_test.cmake
+# The sources are generated corpora (see corpus.hpp), large enough for the queues between the threads to fill up.
+
+foreach(var ASSEMBLER BENCH WORK_DIR)
+    if(NOT ${var})
+        message(FATAL_ERROR "${var} is not set")
+    endif()
+endforeach()
+
+# A stage that fails while the other one keeps producing mustn't hang, every run is given this long
+set(run_timeout 60)
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+
+# Assembles 'source' in WORK_DIR, serially then with --pipeline, and compares the exit codes, the messages and
+# the images. 'expect' is "success" or "failure".
+function(compare_pipeline source expect)
+    foreach(mode serial pipeline)
+        set(options)
+        if(mode STREQUAL "pipeline")
+            set(options --pipeline)
+        endif()
+        # the message names the output file, it is the same for both
+        file(REMOVE ${WORK_DIR}/out.bin)
+        execute_process(COMMAND ${ASSEMBLER} ${options} ${source} out.bin
+                        WORKING_DIRECTORY ${WORK_DIR} TIMEOUT ${run_timeout}
+                        RESULT_VARIABLE ${mode}_result OUTPUT_VARIABLE ${mode}_output ERROR_VARIABLE ${mode}_output)
+        if(NOT ${mode}_result MATCHES "^[0-9]+$")
+            message(FATAL_ERROR "${source} (${mode}) : ${${mode}_result}, the pipeline may be deadlocked")
+        endif()
+        if(EXISTS ${WORK_DIR}/out.bin)
+            file(RENAME ${WORK_DIR}/out.bin ${WORK_DIR}/${source}.${mode}.bin)
+        endif()
+    endforeach()
+
+    if(expect STREQUAL "success" AND NOT serial_result EQUAL 0)
+        message(FATAL_ERROR "${source} doesn't assemble : ${serial_output}")
+    endif()
+    if(expect STREQUAL "failure" AND serial_result EQUAL 0)
+        message(FATAL_ERROR "${source} assembles, it was meant to fail")
+    endif()
+    if(NOT serial_result EQUAL pipeline_result OR NOT serial_output STREQUAL pipeline_output)
+        message(FATAL_ERROR "${source} : the serial path gave ${serial_result} \"${serial_output}\", "
+                            "--pipeline gave ${pipeline_result} \"${pipeline_output}\"")
+    endif()
+    if(expect STREQUAL "success")
+        execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${source}.serial.bin ${source}.pipeline.bin
+                        WORKING_DIRECTORY ${WORK_DIR} RESULT_VARIABLE different)
+        if(different)
+            message(FATAL_ERROR "${source} : --pipeline gives another image than the serial path")
+        endif()
+    endif()
+    message(STATUS "${source} : same ${expect} with and without --pipeline")
+endfunction()
+
+foreach(lines 1000 50000)
+    execute_process(COMMAND ${BENCH} --emit ${WORK_DIR} --lines ${lines} RESULT_VARIABLE result OUTPUT_QUIET)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "floaty_bench --emit failed with ${result}")
+    endif()
+    compare_pipeline(corpus_${lines}.asm success)
+endforeach()
+
+file(READ ${WORK_DIR}/corpus_50000.asm corpus)
+
+# the parser fails on its first batch while the preprocessor still has the whole corpus to push
+file(WRITE ${WORK_DIR}/parse_error_first.asm "first:\nsecond: NOP\n${corpus}")
+compare_pipeline(parse_error_first.asm failure)
+# and on its last one
+file(WRITE ${WORK_DIR}/parse_error_last.asm "${corpus}first:\nsecond: NOP\n")
+compare_pipeline(parse_error_last.asm failure)
+# the preprocessor fails once the parser has taken some of its output
+file(WRITE ${WORK_DIR}/preprocess_error.asm "${corpus}#if\n")
+compare_pipeline(preprocess_error.asm failure)
+# the assembler fails while the parser is still at work
+file(WRITE ${WORK_DIR}/assembler_error.asm "BOGUS B1\n${corpus}")
+compare_pipeline(assembler_error.asm failure)
@@ -0,0 +1,164 @@
+/*
+wave_bypass_test.cpp
+
+Copyright (c) 05 Yann BOUCHER (yann)
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+*/
+
+// Checks that the inputs the preprocessor takes without Wave (see needs_wave() in preprocessor.cpp) give the same
+// preprocessed text, image and errors as when Wave runs them. A -D option sends every input through Wave, an
+// unused one changes nothing else.
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "corpus.hpp"
+#include "driver.hpp"
+#include "preprocessor.hpp"
+
+namespace
+{
+
+struct Case
+{
+    std::string name;
+    std::string source;
+};
+
+// The preprocessed text and the image, or the error
+std::string run(const std::string& source, const floaty::PreprocessOptions& options)
+{
+    std::string result;
+    try
+    {
+        result = floaty::preprocess_source(source, "bypass.asm", options);
+    }
+    catch (const std::exception& e)
+    {
+        return std::string("preprocess error : ") + e.what();
+    }
+
+    try
+    {
+        auto image = floaty::assemble_source(source, "bypass.asm", options);
+        result += "\nimage :";
+        for (uint8_t byte : image)
+        {
+            result += " " + std::to_string(byte);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        result += std::string("\nassemble error : ") + e.what();
+    }
+    return result;
+}
+
+// The line of 'text' where it stops matching the other text, from 'offset'
+std::string excerpt(const std::string& text, size_t offset)
+{
+    const size_t line_start = text.rfind('\n', offset == 0 ? 0 : offset - 1);
+    const size_t begin = line_start == std::string::npos ? 0 : line_start + 1;
+    return text.substr(begin, 160);
+}
+
+std::string with_crlf(const std::string& text)
+{
+    std::string result;
+    for (char c : text)
+    {
+        if (c == '\n') result += '\r';
+        result += c;
+    }
+    return result;
+}
+
+}
+
+int main()
+{
+    std::vector<Case> cases =
+    {
+        {"empty", ""},
+        {"plain", "start: NOP\n  LD B1, 5\n\n\tJP start\n"},
+        {"comments", "start: NOP ; don't\n; a whole line\n   ;\nLD B1, 5;x\nJP start ; \"\n"},
+        {"blank lines", "\n\n\nNOP\n\n\n\nNOP\n \t \nNOP\n"},
+        {"blanks", "a:\t\tNOP   ;x\n  LD  B1 ,\t5 \nLD B2, 1\t; y\n"},
+        {"comment only", "; a\n; b\n"},
+        {"double quotes", "DS \"a;b\" ; c\nDS \"x ; y\"\nDS \"'\" ; '\n"},
+        {"single quotes", "LD B1, ';' ; c\nNOP\n"},
+        {"line comment", "NOP // x ; y\nNOP ; z // w\n"},
+        {"continuation", "LD B1, \\\n5\nNOP\n"},
+        {"continuation in comment", "NOP ; c \\\nNOP\n"},
+        {"continuation in line comment", "NOP // c \\\nNOP\n"},
+        {"crlf", "start: NOP\r\nJP start ; x\r\n\r\nNOP;y\r\n"},
+        {"cr", "NOP\rNOP\n"},
+        {"no final newline", "NOP\nNOP"},
+        {"no final newline after comment", "NOP\nNOP ; c"},
+        {"hash", "  #define X 1\nLD B1, X\n"},
+        {"hash in comment", "NOP ; #define X 1\nNOP\n"},
+        {"hash after code", "NOP #\n"},
+        {"operators", "LD B1, 1+2\nLD B2, 3 - 1\n"},
+        {"numbers", "LD B1, 0x1f\nLD B2, 12ab\nLD B3, .5\n"},
+        {"stray text", "NOP\nFOO B1\n"},
+    };
+
+    for (uint32_t seed { 1 }; seed <= 3; ++seed)
+    {
+        floaty::CorpusOptions options;
+        options.lines = 5000;
+        options.seed = seed;
+        options.directives = false;
+        const auto corpus = floaty::generate_corpus(options).main;
+        cases.push_back({"corpus " + std::to_string(seed), corpus});
+        cases.push_back({"corpus crlf " + std::to_string(seed), with_crlf(corpus)});
+        cases.push_back({"corpus without final newline " + std::to_string(seed), corpus.substr(0, corpus.size() - 1)});
+    }
+
+    floaty::PreprocessOptions bypass;
+    floaty::PreprocessOptions wave;
+    wave.defines.push_back("FLOATY_WAVE_BYPASS_TEST");
+
+    size_t failures { 0 };
+    for (const auto& test : cases)
+    {
+        const auto expected = run(test.source, wave);
+        const auto result = run(test.source, bypass);
+        if (result != expected)
+        {
+            const auto mismatch = std::mismatch(expected.begin(), expected.end(), result.begin(), result.end());
+            const size_t offset = mismatch.first - expected.begin();
+            std::cout << test.name << " : FAILED at offset " << offset << "\n"
+                      << "with Wave :\n" << excerpt(expected, offset) << "\n"
+                      << "without Wave :\n" << excerpt(result, offset) << "\n";
+            ++failures;
+        }
+        else
+        {
+            std::cout << test.name << " : ok\n";
+        }
+    }
+
+    std::cout << cases.size() - failures << "/" << cases.size() << " inputs preprocess the same without Wave\n";
+    return failures ? 1 : 0;
+}